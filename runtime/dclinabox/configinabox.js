@@ -22,3 +22,6 @@ DCLinaboxWidth = 80;
 // suppress scrollbar using 0 or set to number of lines in buffer (e.g. 500)
 DCLinaboxScroll = 0;
 
+// terminal data as (unconverted) binary WebSocket frames (true or false)
+DCLinaboxBinary = false;
+
@@ -6,6 +6,7 @@
 // Based on ShellInABox ... http://shellinabox.com/
 // Copyright (C) 2008,2009 Markus Gutschke <markus@shellinabox.com>
 //
+// 16-OCT-2026  AGT  v1.2.0, binary terminal transport (DCLinaboxBinary)
 // 01-OCT-2012  MGD  v1.1.0, single sign-on (in DCLINABOX.EXE)
 //                           dynamic terminal resize
 //                           refine process termination reporting
@@ -17,9 +18,11 @@
 // 28-APR-2012  MGD  v1.0.1, kludge for Firefox line height discrepencies
 //                           DCLinaboxWxH configuration
 // 04-DEC-2011  MGD  initial
-var DCLinaboxVersion = "v1.1.1";
+var DCLinaboxVersion = "v1.2.0";
 // versions of DCLBINABOX.EXE this JavaScript is compatible with
-var compatibleVersions = new Array ("1.1.0","1.1.1"); 
+var compatibleVersions = new Array ("1.1.0","1.1.1","1.2.0"); 
+// versions of DCLBINABOX.EXE supporting binary terminal transport
+var binaryVersions = new Array ("1.2.0");
 
 /////////////////////////
 // configuration settings
@@ -83,6 +86,9 @@ getParameter('DCLinaboxScroll',0);
 // obscuring the application by using an alternate script name
 getParameter('DCLinaboxScriptName','dclinabox');
 
+// request terminal data as (unconverted) binary WebSocket frames
+getParameter('DCLinaboxBinary',false);
+
 // explicitly title the window
 getParameter('DCLinaboxTitle','');
 
@@ -112,6 +118,7 @@ var vtstatus = null;
 var vtinabox = null;
 var esc = String.fromCharCode(27);
 var compatibilityAlert = true;
+var binaryTransport = false;
 
 // 0=unconnected,1=connecting,2=connected,3..n=data_rx,
 // -1=[disconnect],-2=logout,-3=terminated
@@ -119,6 +126,7 @@ var connectionStatus = 0;
 
 // character sequences emitted by DCLINABOX.EXE for signalling purposes
 var substrEscape =    "\r\x02" + "DCLinabox\x03\r\\";
+var binaryEscape =    substrEscape + "7";
 var alertEscape =     substrEscape + "6"; //(plus message string)
 var logoutEscape =    substrEscape + "5";
 var termSizeEscape =  substrEscape + "4"; //(plus WxH string)
@@ -206,7 +214,7 @@ extend(DCLinabox, VT100);
 
 DCLinabox.prototype.keysPressed = function(ch) {
   if (dclws)
-     dclws.send(ch);
+     dclwsSend(ch);
   else
   if (ch == esc)
      connTerm();
@@ -304,6 +312,7 @@ function webSocketOpen () {
       URL += DCLinaboxScriptName;
 
    connectionStatus = 1;
+   binaryTransport = false;
 
    try { dclws = new WebSocket(URL) }
    catch (err) { alert(err); }
@@ -317,6 +326,9 @@ function webSocketOpen () {
       return;
    }
 
+   // binary frames delivered as ArrayBuffer (see dclwsData())
+   dclws.binaryType = 'arraybuffer';
+
    // WebSocket open
 
    dclws.onopen = function(evt) {
@@ -366,9 +378,10 @@ function webSocketOpen () {
    // WebSocket data from PTD
 
    dclws.onmessage = function (evt) { 
-      if (evt.data.substr(0,substrEscape.length) == substrEscape) {
+      var data = dclwsData(evt.data);
+      if (data.substr(0,substrEscape.length) == substrEscape) {
          // a DCLinabox 'escape' sequence emitted by the executable
-         if (evt.data == logoutEscape) {
+         if (data == logoutEscape) {
             if (DCLinaboxAnother && DCLinaboxLogoutClose)
                window.close();
             else {
@@ -377,36 +390,45 @@ function webSocketOpen () {
             }
          }
          else
-         if (evt.data == terminateEscape) {
+         if (data == terminateEscape) {
             connectionStatus = -3;
             dclws.close();
          }
          else
-         if (evt.data.substr(0,alertEscape.length) == alertEscape) {
+         if (data.substr(0,alertEscape.length) == alertEscape) {
             connectionStatus++;
-            var msg = evt.data.substr(alertEscape.length);
+            var msg = data.substr(alertEscape.length);
             alert (msg);
          }
          else
-         if (evt.data.substr(0,termSizeEscape.length) == termSizeEscape) {
+         if (data.substr(0,termSizeEscape.length) == termSizeEscape) {
             connectionStatus++;
-            var termSize = evt.data.substr(termSizeEscape.length);
+            var termSize = data.substr(termSizeEscape.length);
             var WxH = termSize.split('x');
             if (WxH.length == 2)
                resizeTerminal (parseInt(WxH[0]), parseInt(WxH[1]));
          }
          else
-         if (evt.data.substr(0,titleEscape.length) == titleEscape) {
+         if (data.substr(0,titleEscape.length) == titleEscape) {
             connectionStatus++;
-            var title = evt.data.substr(titleEscape.length);
+            var title = data.substr(titleEscape.length);
             setDCLinaboxTitle (title);
          }
          else
-         if (evt.data.substr(0,versionEscape.length) == versionEscape) {
+         if (data.substr(0,versionEscape.length) == versionEscape) {
             connectionStatus++;
-            var version = evt.data.substr(versionEscape.length);
+            var version = data.substr(versionEscape.length);
             if (compatibleVersions.indexOf(version) != -1)
                compatibilityAlert = false;
+            if (DCLinaboxBinary && typeof Uint8Array != 'undefined' &&
+                binaryVersions.indexOf(version) != -1)
+               dclws.send(binaryEscape);
+         }
+         else
+         if (data == binaryEscape) {
+            // executable acknowledges, from now keystrokes go as binary
+            connectionStatus++;
+            binaryTransport = true;
          }
          else
             alert ('Unknown DCLinabox escape!');
@@ -418,12 +440,38 @@ function webSocketOpen () {
             alert(DCLinaboxMessage.COMPAT);
          }
          connectionStatus++;
-         var termResponse = thisDCLinabox.vt100(evt.data);
-         if (termResponse.length) dclws.send(termResponse); 
+         var termResponse = thisDCLinabox.vt100(data);
+         if (termResponse.length) dclwsSend(termResponse); 
       }
    };
 }
 
+// WebSocket binary frame (ArrayBuffer) to string of 8 bit characters
+// (not TextDecoder('latin1') which is windows-1252 and maps C1 controls)
+
+function dclwsData (data) {
+   if (typeof data == 'string') return data;
+   var bytes = new Uint8Array(data);
+   var str = '';
+   for (var idx = 0; idx < bytes.length; idx += 8192)
+      str += String.fromCharCode.apply(null, bytes.subarray(idx,idx+8192));
+   return str;
+}
+
+// send to the executable, as binary when that transport is in use
+// (characters beyond 8 bits are dropped just as the executable would)
+
+function dclwsSend (str) {
+   if (!binaryTransport) { dclws.send(str); return; }
+   var bytes = new Uint8Array(str.length);
+   var cnt = 0;
+   for (var idx = 0; idx < str.length; idx++) {
+      var ch = str.charCodeAt(idx);
+      if (ch <= 0xff) bytes[cnt++] = ch;
+   }
+   dclws.send(bytes.subarray(0,cnt));
+}
+
 ///////////////////////////
 // get parameters from hash
 ///////////////////////////
@@ -685,7 +733,7 @@ function changedWxH () {
    var selectwxh = document.getElementById('selectWxH');
    var wxh = selectwxh.options[selectwxh.selectedIndex].text;
    buttonWxH(wxh);
-   if (dclws) dclws.send(termSizeEscape+wxh);
+   if (dclws) dclwsSend(termSizeEscape+wxh);
 }
 
 // make the WxH button
@@ -33,13 +33,15 @@ be used.   Define this system-wide using a value of "*" to simply allow
 experimentation.  Alternatively provide one or more comma-separated,
 dotted-decimal IP address to specify one or more hosts allowed to use the
 script, and/or one or more comman-separated IP addresses and CIDR subnet mask
-to specify a range of hosts.  IPv4 only!  For example
+to specify a range of hosts.  IPv4 and IPv6 addresses may be used (an IPv4
+address also matches the IPv4-mapped IPv6 equivalent).  For example
 
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "*"
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "192.168.1.2"
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "192.168.1.2,192.168.1.3"
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "192.168.1.0/24"
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "192.168.1.0/24,192.168.2.2"
+  $ DEFINE /SYSTEM DCLINABOX_ENABLE "2001:db8::/32,192.168.2.2"
 
 By default the WebSocket, and hence all traffic to and from the DCLinabox login
 and session, is only allowed over Secure Sockets Layer.  To allow access via
@@ -48,6 +50,11 @@ clear-text connections add "ws:" somewhere in the logical name value.
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "ws:,*"
   $ DEFINE /SYSTEM DCLINABOX_ENABLE "192.168.1.0/24,ws:,192.168.2.2"
 
+This and the other DCLINABOX_.. logical names are read at startup and every
+fifteen seconds, with changes taking effect from then.  DCLINABOX_ENABLE and
+DCLINABOX_SSO are also checked with each connection, so access control changes
+take effect with the very next connection.
+
 
 SINGLE SIGN-ON
 --------------
@@ -107,6 +114,20 @@ does not occur and the terminal session just prompts for credentials as usual.
 Of course, even if the logical name does not allow SSO, the access to DCLinabox
 is still controlled by the web server authentication and authorisation.
 
+The account flags and privileges checked for SSO are cached (by username) for
+a short period, by default fifteen seconds, so a burst of reconnections does
+not each require a SYSUAF lookup.  The logical name DCLINABOX_UAI_CACHE
+specifies the number of seconds, zero disables the cache.  The cache is
+emptied whenever the value of DCLINABOX_SSO or DCLINABOX_UAI_CACHE changes.
+
+  $ DEFINE /SYSTEM DCLINABOX_UAI_CACHE 60
+
+SYSUAF changes are not otherwise noticed, so an account that is DISUSERed (or
+has privileges removed) may continue to be allowed SSO for up to that period.
+To have such a change apply within fifteen seconds, change the value.
+
+  $ DEFINE /SYSTEM DCLINABOX_UAI_CACHE 59
+
 The logical name DCLINABOX_ANNOUNCE allows an SSO session establishment
 announcement to be displayed in the terminal window.  This multi-valued logical
 name appends carriage-control to each value displaying it as separate line.
@@ -161,12 +182,48 @@ message (which may contain just one "%d" to substitute the minutes warning):
   "360,10,WARNING - disconnection in %d minutes!"
 
 
+OUTPUT COALESCING
+-----------------
+Bursts of terminal output (e.g. DIRECTORY, TYPE) are gathered for a short
+period into the one WebSocket message rather than each PTD read becoming a
+message of its own.  Output is sent immediately if the client has just provided
+input (so echo is not delayed), if the buffer is nearly full, or when the
+(default two millisecond) period expires.  The logical name DCLINABOX_COALESCE
+specifies the period in milliseconds (up to 100).  Define to 0 to disable.
+Propagated to new sessions.
+
+  $ DEFINE /SYSTEM DCLINABOX_COALESCE 5
+
+
+OUTPUT COMPRESSION
+------------------
+If DCLinabox (and wsLIB) is built with zlib (see BUILD_DCLINABOX.COM) the
+WebSocket permessage-deflate extension offered by browsers may be accepted,
+considerably reducing the network traffic of text-heavy terminal output.  The
+logical name DCLINABOX_DEFLATE enables it, specifying the compression window
+bits (9 to 15).  Each session requires approximately 256kB more memory with a
+15 bit window, 9 bits considerably less.  Propagated to new sessions.
+
+  $ DEFINE /SYSTEM DCLINABOX_DEFLATE 15
+
+
+BINARY TRANSPORT
+----------------
+By default terminal output is converted to UTF-8 and sent as WebSocket text
+frames, with keystrokes converted back from UTF-8.  When so configured a
+v1.2.0 (or later) JavaScript terminal requests binary transport at session
+establishment after which terminal bytes are sent and received as binary
+frames without conversion, 8 bit characters being mapped in the browser.
+
+  DCLinaboxBinary = true;  // in CONFIGINABOX.JS to enable
+
+
 SESSION ANNOUNCEMENT
 --------------------
 The logical name DCLINABOX_ALERT results in an announcement being displayed in
 a browser alert dialog.  This alert will be delivered at session establishment
 if it exists at the time, perhaps as a permanent announcement, otherwise will
-be alerted within a minute of it first being defined.  If an ephemeral
+be alerted within fifteen seconds of it first being defined.  If an ephemeral
 announcement it should be undefined when no longer relevant.  For example
 
   $ DEFINE /SYSTEM DCLINABOX_ALERT -
@@ -202,6 +259,24 @@ http://www.gnu.org/licenses/gpl.txt
 
 VERSION HISTORY
 ---------------
+16-OCT-2026  AGT  v1.2.0, client read always queued, input queue drained
+                            (merged) into PTD writes as they complete
+                          terminal output framed in-place in PtdReadBuffer
+                          coalesce bursts of terminal output (DCLINABOX_COALESCE)
+                          pause PTD reads while WebSocket output is backlogged
+                          permessage-deflate (DCLINABOX_DEFLATE)
+                          binary terminal transport (requested by client)
+                          version, alert and idle warning messages prepared
+                            once (WsLibMsgPrepare()) for all sessions
+                          DCLINABOX_ENABLE compiled (when changed) into an
+                            address prefix trie, IPv6 addresses and subnets
+                          DCLINABOX_SSO compiled (when changed) into per-realm
+                            username hashes, one account check per decision
+                          SSO account (UAI) lookups cached (DCLINABOX_UAI_CACHE)
+                          logical names read into a configuration snapshot
+                            parsed (and replaced) only when changed
+                          connect-time version, alert and announcement
+                            rendered per snapshot as one pre-framed block
 08-DEC-2012  MGD  v1.1.1, tidied some #includes
                           bugfix; SessionManagement() NULL pointer
 01-OCT-2012  MGD  v1.1.0, single sign-on (no-password required terminal)
@@ -218,7 +293,7 @@ VERSION HISTORY
 #endif /* COMMENTS_WITH_COMMENTS */
 /*****************************************************************************/
 
-#define SOFTWAREVN "1.1.1"
+#define SOFTWAREVN "1.2.0"
 /*                  ^^^^^ don't forget to update DCLINABOX.JS compliance! */
 #define SOFTWARENM "DCLINABOX"
 #ifdef __ALPHA
@@ -280,8 +355,26 @@ VERSION HISTORY
 #define PTD_WRITE_SIZE 8192
 #endif
 
+/* client input queued while a PTD write is in progress */
+#define PTD_QUEUE_SIZE PTD_WRITE_SIZE
+
+/* coalesced output flushed when less than this space remains */
+#define PTD_COALESCE_MIN (PTD_READ_SIZE / 4)
+
+/* output flush causes (see PtdOutputFlush()) */
+#define PTD_FLUSH_NOW    0
+#define PTD_FLUSH_INPUT  1
+#define PTD_FLUSH_FULL   2
+#define PTD_FLUSH_TIMER  3
+
+/* WebSocket queued output high-water marks (see WsLibSetOutputLimit()) */
+#define OUTPUT_LIMIT_BYTES 65536
+#define OUTPUT_LIMIT_MSGS     32
+
+#define DEFAULT_COALESCE_MSECS 2
 #define DEFAULT_IDLE_MINS    120
 #define DEFAULT_WARN_MINS      5
+#define DEFAULT_UAI_CACHE_SECS 15
 #define DEFAULT_WARN_MESSAGE "This idle terminal will be disconnected " \
                              "in %d minutes!"
 
@@ -296,10 +389,14 @@ unsigned long  ScriptUic;
 
 char  AlertLogicalName [128],
       AnnounceLogicalName [128],
+      CoalesceLogicalName [128],
+      DeflateLogicalName [128],
       EnableLogicalName [128],
       IdleLogicalName [128],
       SingleLogicalName [128],
+      UaiCacheLogicalName [128],
       DCLinaboxEscape [] = DCLINABOX_ESCAPE,
+      BinaryEscape [] =    DCLINABOX_ESCAPE "7",
       AlertEscape [] =     DCLINABOX_ESCAPE "6", /* plus message string */
       LogoutEscape [] =    DCLINABOX_ESCAPE "5",
       TermSizeEscape [] =  DCLINABOX_ESCAPE "4", /* plus WxH string */
@@ -314,18 +411,33 @@ struct PtdClient {
          PtdWriteBuffer [PTD_WRITE_SIZE];
 
    int  Alerted,
+        CoalesceMsecs,
+        CoalesceTimer,
         IdleMins,
+        InputPaused,
+        InputPending,
+        InputQueueCount,
         LogoutResponse,
+        OutputCount,
+        OutputOffset,
+        OutputPaused,
+        OutputWriting,
         ProcessPid,
         PtdQueuedRead,
         PtdQueuedWrite,
         PtdReadCount,
+        PtdReadOffset,
         PtdWriteCount,
+        Removed,
         WarnMins;
 
    unsigned long  ClientCount,
+                  CoalesceDelta [2],
                   DviOwnUic,
                   DviPid,
+                  FlushBytes,
+                  FlushCause [4],
+                  FlushCount,
                   IdleCount,
                   IdleTime,
                   WarnTime;
@@ -334,6 +446,7 @@ struct PtdClient {
 
    char  DviHostName [8+1],
          InputBuffer [256],
+         InputQueue [PTD_QUEUE_SIZE],
          HttpHost [64],
          JpiPrcNam [15+1],
          OwnIdent [31+1],
@@ -347,23 +460,146 @@ struct PtdClient {
 
 long  PtdClientPages = (sizeof(struct PtdClient) / 512 ) + 1;
 
+/* settings parsed from the logical names (see ConfigLoad()) */
+#define CONFIG_ALERT     0
+#define CONFIG_ANNOUNCE  1
+#define CONFIG_COALESCE  2
+#define CONFIG_DEFLATE   3
+#define CONFIG_ENABLE    4
+#define CONFIG_IDLE      5
+#define CONFIG_SSO       6
+#define CONFIG_UAI_CACHE 7
+#define CONFIG_COUNT     8
+
+#define CONFIG_VALUES_MAX (2 * 128 * 258 + CONFIG_COUNT * 258)
+#define CONFIG_ACCESS_MAX (128 * 258 + 2 * 258)
+
+struct DCLinaboxConfig {
+   int  AnnounceLength,
+        CoalesceMsecs,
+        DeflateBits,
+        Generation,
+        IdleMins,
+        UaiCacheSecs,
+        WarnMins;
+   char  *AlertPtr,
+         *AnnouncePtr,
+         *EnablePtr,
+         *SsoPtr,
+         *WarnMsgPtr;
+   /* connect-time preamble, plus announcement for single sign-on */
+   struct WsLibPrepStruct  *PreamblePtr,
+                           *SsoPreamblePtr;
+   /* each logical name's translated values (see ConfigAccess()) */
+   int  ValueOffset [CONFIG_COUNT+1];
+   /* the translated values (must be last) */
+   char  Values [1];
+};
+
+struct DCLinaboxConfig  *ConfigPtr;
+
+/* DCLINABOX_ENABLE compiled into a binary trie (see EnableCompile()) */
+struct EnableNode {
+   int  Allow;
+   unsigned int  Child [2];
+};
+
+int  EnableAll,
+     EnableClear,
+     EnableGeneration,
+     EnableNodeCount,
+     EnableNodeSize;
+
+struct EnableNode  *EnableNodePtr;
+
+/* DCLINABOX_SSO compiled per realm (see SsoCompile()) */
+#define SSO_HASH_SIZE 64
+
+#define SSO_WILD      0x01  /* '*' */
+#define SSO_WILD_PRIV 0x02  /* '**' */
+#define SSO_WILD_NOT  0x04  /* '!*' */
+
+struct SsoUser {
+   struct SsoUser  *NextPtr;
+   int  AllowAt,
+        DenyAt;
+   char  *UserName;
+};
+
+struct SsoRealm {
+   struct SsoRealm  *NextPtr;
+   int  EntryCount,
+        WildAt,
+        WildType;
+   char  *RealmName;
+   struct SsoUser  *UserHash [SSO_HASH_SIZE];
+};
+
+int  SsoGeneration;
+
+struct SsoRealm  *SsoRealmList;
+
+/* SSO account lookups, least-recently-used first out (see UaiLookup()) */
+#define UAI_CACHE_MAX  64
+#define UAI_CACHE_HASH 32
+
+struct UaiCache {
+   struct UaiCache  *HashNextPtr,
+                    *LruNextPtr,
+                    *LruPrevPtr;
+   unsigned int  CacheTime;
+   unsigned long  UaiFlags,
+                  UaiPriv [2];
+   char  UserName [32+1];
+};
+
+int  UaiCacheCount,
+     UaiCacheSecs = -1;
+
+struct UaiCache  *UaiCacheFreePtr,
+                 *UaiCacheLruHead,
+                 *UaiCacheLruTail;
+
+struct UaiCache  *UaiCacheHash [UAI_CACHE_HASH];
+struct UaiCache  UaiCachePool [UAI_CACHE_MAX];
+
 long  CharBuf [3];
 
 /* function prototypes */
 void AddClient ();
 void AdviseClientTermSize (struct PtdClient*);
 void ClientEscape (struct PtdClient*, char*, int);
+int ConfigAccess ();
+int ConfigLoad ();
+char* ConfigTranslate (int, char*, char*);
 int DCLinaboxEnable ();
 int DCLinaboxSingleSignOn (struct PtdClient*);
+int EnableAllowed (unsigned char*);
+void SsoCompile (struct WsLibStruct*, char*);
+unsigned int SsoHash (char*);
+int UaiLookup (struct WsLibStruct*, char*, unsigned long*, unsigned long*);
+void UaiCachePurge ();
+void UaiCacheUnlink (struct UaiCache*);
+void EnableCompile (char*);
+void EnableInsert (unsigned char*, int);
+int IpAddressParse (char*, unsigned char*);
+int IpAddress4Parse (char*, unsigned char*);
 int PtdOpen (struct PtdClient*);
 void PtdClose (struct PtdClient*);
 int PtdCrePrc (struct PtdClient*);
 void PtdRead (struct PtdClient*);
 void PtdReadClient (struct WsLibStruct*);
 void PtdRemoveClient (struct WsLibStruct *wsptr);
+void PtdFreeClient (struct PtdClient*);
 void PtdTerminateAst (struct PtdClient*);
 void PtdReadAst (struct PtdClient*);
+void PtdReadNext (struct PtdClient*);
+void PtdCoalesceAst (struct PtdClient*);
+void PtdOutput (struct PtdClient*);
+void PtdOutputFlush (struct PtdClient*, int);
+void PtdWritable (struct WsLibStruct*);
 void PtdReadWriteAst (struct WsLibStruct*);
+void PtdReadClientQueue (struct PtdClient*);
 void PtdWrite (struct PtdClient*, char*, int);
 void PtdWriteAst (struct PtdClient*);
 void SessionManagement ();
@@ -428,12 +664,18 @@ main (int argc, char *argv[])
    strcpy (AlertLogicalName+len, "_ALERT");
    strncpy (AnnounceLogicalName, AlertLogicalName, len);
    strcpy (AnnounceLogicalName+len, "_ANNOUNCE");
+   strncpy (CoalesceLogicalName, AlertLogicalName, len);
+   strcpy (CoalesceLogicalName+len, "_COALESCE");
+   strncpy (DeflateLogicalName, AlertLogicalName, len);
+   strcpy (DeflateLogicalName+len, "_DEFLATE");
    strncpy (EnableLogicalName, AlertLogicalName, len);
    strcpy (EnableLogicalName+len, "_ENABLE");
    strncpy (IdleLogicalName, AlertLogicalName, len);
    strcpy (IdleLogicalName+len, "_IDLE");
    strncpy (SingleLogicalName, AlertLogicalName, len);
    strcpy (SingleLogicalName+len, "_SSO");
+   strncpy (UaiCacheLogicalName, AlertLogicalName, len);
+   strcpy (UaiCacheLogicalName+len, "_UAI_CACHE");
 
    /* no clients is two minutes in seconds */
    WsLibSetLifeSecs (2*60);
@@ -448,6 +690,9 @@ main (int argc, char *argv[])
 
       UsageCount++;
 
+      /* access control changes apply to the very next connection */
+      ConfigAccess ();
+
       if (DCLinaboxEnable()) AddClient ();
 
       WsLibCgiPlusEof ();
@@ -468,11 +713,12 @@ processing.
 void AddClient ()
 
 {
-   int  idx, len, sso, status;
+   static struct WsLibPrepStruct  *VersionPrepPtr;
+
+   int  len, sso, status;
    short int  slen;
-   char  *aptr, *cptr, *sptr, *zptr;
-   char  AlertMsg [sizeof(AlertEscape)+256],
-         AnnounceLine [256+2];
+   char  *cptr, *sptr, *zptr;
+   char  AlertMsg [sizeof(AlertEscape)+256];
    struct PtdClient  *clptr;
    $DESCRIPTOR (AlertMsgDsc, AlertMsg);
 
@@ -492,6 +738,15 @@ void AddClient ()
       *sptr = '\0';
    }
 
+   /* period terminal output is coalesced (zero disables) */
+   clptr->CoalesceMsecs = ConfigPtr->CoalesceMsecs;
+   /* delta time in 100nS units */
+   clptr->CoalesceDelta[0] = -10000 * clptr->CoalesceMsecs;
+   clptr->CoalesceDelta[1] = -1;
+
+   /* permessage-deflate window bits (zero disables) */
+   WsLibSetDeflate (ConfigPtr->DeflateBits, 0);
+
    /* create a WebSocket library structure for the client */
    if (!(clptr->WsLibPtr = WsLibCreate (clptr, PtdRemoveClient)))
    {
@@ -507,18 +762,25 @@ void AddClient ()
 
    WsLibWatchScript (clptr->WsLibPtr, FI_LI, "!AZ", SOFTWAREID);
 
+   /* bound queued output, pausing terminal output until it drains */
+   WsLibSetOutputLimit (clptr->WsLibPtr, OUTPUT_LIMIT_BYTES, OUTPUT_LIMIT_MSGS);
+   WsLibSetWritableCallback (clptr->WsLibPtr, PtdWritable);
+
    if ((status = DCLinaboxSingleSignOn (clptr)) == SS$_NORMAL)
       status = PtdCrePrc (clptr);
    else
    if (VMSok(status))
       status = PtdOpen (clptr);
 
-   /* inform the JavaScript which version executable it's dealing with */
-   WsLibWrite (clptr->WsLibPtr, VersionEscape,
-               sizeof(VersionEscape)-1, WSLIB_ASYNCH);
-
    if (VMSnok (status))
    {
+      /* inform the JavaScript which version executable it's dealing with */
+      if (!VersionPrepPtr)
+         VersionPrepPtr = WsLibMsgPrepare (VersionEscape,
+                                           sizeof(VersionEscape)-1,
+                                           WSLIB_OPCODE_TEXT);
+      WsLibWritePrepared (clptr->WsLibPtr, VersionPrepPtr, WSLIB_ASYNCH);
+
       /* unsuccessful create alert */
       zptr = (sptr = AlertMsg) + sizeof(AlertMsg)-1;
       for (cptr = AlertEscape; *cptr && sptr < zptr; *sptr++ = *cptr++);
@@ -532,30 +794,15 @@ void AddClient ()
       WsLibClose (clptr->WsLibPtr, 0, NULL);
       return;
    }
-   else
-   if (aptr = SysTrnLnm (AlertLogicalName, NULL, 0))
-   {
-      /* session alert */
-      zptr = (sptr = AlertMsg) + sizeof(AlertMsg)-1;
-      for (cptr = AlertEscape; *cptr && sptr < zptr; *sptr++ = *cptr++);
-      for (cptr = aptr; *cptr && sptr < zptr; *sptr++ = *cptr++);
-      WsLibWrite (clptr->WsLibPtr, AlertMsg, sptr-AlertMsg, WSLIB_ASYNCH);
-      clptr->Alerted = 1;
-   }
 
-   if (VMSok (status) && clptr->VmsUserName[0])
-   {
-      /* successful single sign-on terminal */
-      for (idx = 0; idx <= 127; idx++)
-      {
-         /* single sign-on session announcement */
-         if (!SysTrnLnm (AnnounceLogicalName, AnnounceLine, idx)) break;
-         slen = strlen(AnnounceLine);
-         AnnounceLine[slen++] = '\r';
-         AnnounceLine[slen++] = '\n';
-         WsLibWrite (clptr->WsLibPtr, AnnounceLine, slen, WSLIB_ASYNCH);
-      }
-   }
+   /* version, any session alert, any single sign-on announcement, one write */
+   if (clptr->VmsUserName[0] && ConfigPtr->SsoPreamblePtr)
+      WsLibWritePrepared (clptr->WsLibPtr, ConfigPtr->SsoPreamblePtr,
+                          WSLIB_ASYNCH);
+   else
+      WsLibWritePrepared (clptr->WsLibPtr, ConfigPtr->PreamblePtr,
+                          WSLIB_ASYNCH);
+   if (ConfigPtr->AlertPtr) clptr->Alerted = 1;
 
    /* queue an asynchronous read from the client */
    WsLibRead (clptr->WsLibPtr,
@@ -568,7 +815,10 @@ void AddClient ()
 
 /*****************************************************************************/
 /*
-Remove the client structure from the list and free the memory.
+Remove the client structure from the list and free the memory.  A coalesce
+timer AST may already have been delivered (and so not cancellable) but still be
+waiting to run, so the client is marked as removed and the memory freed by an
+AST queued behind any such.
 */
 
 void PtdRemoveClient (struct WsLibStruct *wsptr)
@@ -585,12 +835,34 @@ void PtdRemoveClient (struct WsLibStruct *wsptr)
 
    if (clptr->ptdchan) status = ptd$delete (clptr->ptdchan);
 
-   status = lib$free_vm_page (&PtdClientPages, &clptr);
+   clptr->Removed = 1;
+   if (clptr->CoalesceTimer) sys$cantim (clptr, 0);
+
+   /* behind any delivered timer AST (even one cancelled by a flush) */
+   status = sys$dclast (PtdFreeClient, clptr, 0);
    if (VMSnok(status)) EXIT_FI_LI (status);
 
    if (ConnectedCount) ConnectedCount--;
 }
 
+/*****************************************************************************/
+/*
+Free the client structure memory (see PtdRemoveClient()).
+*/
+
+void PtdFreeClient (struct PtdClient *clptr)
+
+{
+   int  status;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   status = lib$free_vm_page (&PtdClientPages, &clptr);
+   if (VMSnok(status)) EXIT_FI_LI (status);
+}
+
 /*****************************************************************************/
 /*
 Create the pseudo-terminal and begin reading from it.
@@ -813,14 +1085,16 @@ void PtdClose (struct PtdClient *clptr)
 
 /*****************************************************************************/
 /*
-Data has been read from the PTD (i.e. from the system).
+Data has been read from the PTD (i.e. from the system).  Append it to any
+output being coalesced (the read was into the buffer following that data) and
+then decide whether to send it or read more.
 */
 
 void PtdReadAst (struct PtdClient *clptr)
 
 {
    int  bcnt, status;
-   char  *bptr, *cptr, *zptr;
+   char  *bptr, *cptr, *rptr, *zptr;
 
    /*********/
    /* begin */
@@ -828,11 +1102,13 @@ void PtdReadAst (struct PtdClient *clptr)
 
    if (clptr->PtdQueuedRead) clptr->PtdQueuedRead--;
 
-   status = *(short*)clptr->PtdReadBuffer;
+   rptr = clptr->PtdReadBuffer + clptr->PtdReadOffset;
+
+   status = *(short*)rptr;
    if (VMSok(status))
    {
-      bptr = clptr->PtdReadBuffer + sizeof(short)+sizeof(short);
-      bcnt = *(short*)(clptr->PtdReadBuffer + sizeof(short));
+      bptr = rptr + sizeof(short)+sizeof(short);
+      bcnt = *(short*)(rptr + sizeof(short));
 
       /*
          Check if it looks like a LOGOUT response.
@@ -871,16 +1147,204 @@ void PtdReadAst (struct PtdClient *clptr)
          }
       }
 
-      WsLibWrite (clptr->WsLibPtr, bptr, bcnt, PtdReadWriteAst);
+      if (clptr->OutputCount)
+      {
+         /* close the gap left by the read's status and count words */
+         memmove (clptr->PtdReadBuffer + clptr->OutputOffset +
+                                         clptr->OutputCount, bptr, bcnt);
+      }
+      else
+         clptr->OutputOffset = bptr - clptr->PtdReadBuffer;
+      clptr->OutputCount += bcnt;
+
+      /* if a write is in progress PtdReadWriteAst() will continue */
+      if (clptr->OutputWriting) return;
+
+      PtdOutput (clptr);
    }
    else
       PtdClose (clptr);
 }
 
+/*****************************************************************************/
+/*
+Queue a read from the PTD into the buffer space following any output being
+coalesced (quadword aligned, the data is moved down by PtdReadAst()).  If the
+client has fallen behind (WebSocket output backlogged) then leave the terminal
+output in the PTD until PtdWritable() is called.
+*/
+
+void PtdReadNext (struct PtdClient *clptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!WsLibIsWritable (clptr->WsLibPtr))
+   {
+      WsLibWatchScript (clptr->WsLibPtr, FI_LI, "PAUSE !UL bytes queued",
+                        WsLibOutputQueued (clptr->WsLibPtr, NULL));
+      clptr->OutputPaused = 1;
+      return;
+   }
+
+   if (clptr->OutputCount)
+      clptr->PtdReadOffset = (clptr->OutputOffset + clptr->OutputCount + 7) &
+                             ~7;
+   else
+      clptr->PtdReadOffset = 0;
+
+   clptr->PtdQueuedRead++;
+   ptd$read (0, clptr->ptdchan, &PtdReadAst, clptr,
+             clptr->PtdReadBuffer + clptr->PtdReadOffset,
+             sizeof(clptr->PtdReadBuffer) - clptr->PtdReadOffset);
+}
+
+/*****************************************************************************/
+/*
+Output has been read from the PTD.  Send it immediately if the client has just
+provided input (so echo is not delayed), if the buffer is nearly full, or if
+coalescing is disabled.  Otherwise start the coalescing timer (if not already)
+and read more.
+*/
+
+void PtdOutput (struct PtdClient *clptr)
+
+{
+   int  status;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!clptr->OutputCount)
+      PtdReadNext (clptr);
+   else
+   if (!clptr->CoalesceMsecs)
+      PtdOutputFlush (clptr, PTD_FLUSH_NOW);
+   else
+   if (clptr->InputPending)
+      PtdOutputFlush (clptr, PTD_FLUSH_INPUT);
+   else
+   if (sizeof(clptr->PtdReadBuffer) - clptr->OutputOffset - clptr->OutputCount <
+       PTD_COALESCE_MIN)
+      PtdOutputFlush (clptr, PTD_FLUSH_FULL);
+   else
+   {
+      if (!clptr->CoalesceTimer)
+      {
+         status = sys$setimr (0, &clptr->CoalesceDelta,
+                              PtdCoalesceAst, clptr, 0);
+         if (VMSok (status)) clptr->CoalesceTimer = 1;
+      }
+      PtdReadNext (clptr);
+   }
+}
+
+/*****************************************************************************/
+/*
+WebSocket output that had reached the high-water mark has drained.  Resume
+reading from the PTD if that had been paused.
+*/
+
+void PtdWritable (struct WsLibStruct *wsptr)
+
+{
+   struct PtdClient  *clptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   clptr = WsLibGetUserData(wsptr);
+
+   if (!clptr->OutputPaused) return;
+   clptr->OutputPaused = 0;
+
+   /* PtdReadWriteAst() or PtdReadAst() will continue */
+   if (clptr->OutputWriting || clptr->PtdQueuedRead) return;
+
+   PtdOutput (clptr);
+}
+
+/*****************************************************************************/
+/*
+The coalescing period has expired.  If not already being written, send the
+output gathered so far.  Any outstanding PTD read is into the buffer space
+following that data and is unaffected.  If the client has been removed
+in the meantime its websocket no longer exists (see PtdRemoveClient()).
+*/
+
+void PtdCoalesceAst (struct PtdClient *clptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (clptr->Removed) return;
+
+   clptr->CoalesceTimer = 0;
+
+   if (clptr->OutputWriting || !clptr->OutputCount) return;
+
+   PtdOutputFlush (clptr, PTD_FLUSH_TIMER);
+}
+
+/*****************************************************************************/
+/*
+Write the coalesced output to the WebSocket client.  The four bytes preceding
+the data (status and count words of the PTD read) are headroom for the frame
+header.  Keeps count of messages, bytes and the flush causes (WATCHable).
+*/
+
+void PtdOutputFlush
+(
+struct PtdClient *clptr,
+int FlushCause
+)
+{
+   static char  *CauseName [] = { "now", "input", "full", "timer" };
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (clptr->CoalesceTimer)
+   {
+      sys$cantim (clptr, 0);
+      clptr->CoalesceTimer = 0;
+   }
+   clptr->InputPending = 0;
+
+   clptr->FlushCount++;
+   clptr->FlushBytes += clptr->OutputCount;
+   clptr->FlushCause[FlushCause]++;
+
+   WsLibWatchScript (clptr->WsLibPtr, FI_LI,
+"COALESCE !UL bytes (!AZ) msgs:!UL avg:!UL input:!UL full:!UL timer:!UL",
+                     clptr->OutputCount, CauseName[FlushCause],
+                     clptr->FlushCount,
+                     clptr->FlushBytes / clptr->FlushCount,
+                     clptr->FlushCause[PTD_FLUSH_INPUT],
+                     clptr->FlushCause[PTD_FLUSH_FULL],
+                     clptr->FlushCause[PTD_FLUSH_TIMER]);
+
+   clptr->OutputWriting = clptr->OutputCount;
+   clptr->OutputCount = 0;
+
+   WsLibWriteHeadroom (clptr->WsLibPtr,
+                       clptr->PtdReadBuffer + clptr->OutputOffset,
+                       clptr->OutputWriting,
+                       sizeof(short)+sizeof(short), PtdReadWriteAst);
+}
+
 /*****************************************************************************/
 /*
 Data read from the PTD (system) has been written to the WebSocket client. 
-Check status and if OK queue another read from the PTD.
+Check status and if OK deal with any output read in the meantime, or queue
+another read from the PTD (unless one is still outstanding).
 */
 
 void PtdReadWriteAst (struct WsLibStruct *wsptr)
@@ -896,19 +1360,37 @@ void PtdReadWriteAst (struct WsLibStruct *wsptr)
    clptr = WsLibGetUserData(wsptr);
 
    status = WsLibWriteStatus (wsptr);
-   if (VMSok (status))
+   if (VMSnok (status))
    {
-      clptr->PtdQueuedRead++;
-      ptd$read (0, clptr->ptdchan, &PtdReadAst, clptr,
-                clptr->PtdReadBuffer, sizeof(clptr->PtdReadBuffer));
-   }
-   else
       WsLibClose (wsptr, 0, NULL);
+      return;
+   }
+
+   clptr->OutputWriting = 0;
+
+   /* PtdReadAst() will continue */
+   if (clptr->PtdQueuedRead) return;
+
+   if (clptr->OutputCount &&
+       clptr->OutputOffset > sizeof(short)+sizeof(short))
+   {
+      /* move output read during the write to the start of the buffer */
+      memmove (clptr->PtdReadBuffer + sizeof(short)+sizeof(short),
+               clptr->PtdReadBuffer + clptr->OutputOffset,
+               clptr->OutputCount);
+      clptr->OutputOffset = sizeof(short)+sizeof(short);
+   }
+
+   PtdOutput (clptr);
 }
 
 /*****************************************************************************/
 /*
-Asynchronous read from a WebSocket client has concluded.
+Asynchronous read from a WebSocket client has concluded.  Client input is
+written to the PTD or queued if a PTD write is already in progress.  The next
+client read is queued immediately (rather than after the PTD write completes)
+so that typing and pastes continue to be accepted, unless the input queue is
+too full to accept another read, in which case PtdWriteAst() resumes reading.
 */
 
 void PtdReadClient (struct WsLibStruct *wsptr)
@@ -930,40 +1412,50 @@ void PtdReadClient (struct WsLibStruct *wsptr)
 
    clptr = WsLibGetUserData(wsptr);
 
-   if (cnt = WsLibReadCount(wsptr))
+   cnt = WsLibReadCount(wsptr);
+
+   /* text (e.g. sent before binary transport was acknowledged) */
+   if (cnt && WsLibIsSetBinary(wsptr) && WsLibReadIsText(wsptr))
+      if ((cnt = WsLibFromUtf8 (clptr->InputBuffer, cnt, 0)) < 0) cnt = 0;
+
+   if (cnt)
    {
       if (!memcmp (clptr->InputBuffer,
                    DCLinaboxEscape,
                    sizeof(DCLinaboxEscape)-1))
-      {
          ClientEscape (clptr, clptr->InputBuffer, cnt);
-
-         /* queue the next read from the client */
-         WsLibRead (wsptr,
-                    clptr->InputBuffer,
-                    sizeof(clptr->InputBuffer),
-                    PtdReadClient);
-      }
       else
          PtdWrite (clptr, clptr->InputBuffer, cnt);
 
       /* keep track of client input (for idle timeout) */
       clptr->ClientCount++;
 
+      /* send any resulting (echo) output without delay */
+      clptr->InputPending = 1;
+
       /* reset on continued client (keyboard) input */
       if (clptr->LogoutResponse) clptr->LogoutResponse--;
    }
-   else
-      /* otherwise queue the next read from the client */
-      WsLibRead (wsptr,
-                 clptr->InputBuffer,
-                 sizeof(clptr->InputBuffer),
-                 PtdReadClient);
+
+   /* if the queue could not accept another full read then pause reading */
+   if (clptr->InputQueueCount + sizeof(clptr->InputBuffer) >
+       sizeof(clptr->InputQueue))
+   {
+      clptr->InputPaused = 1;
+      return;
+   }
+
+   /* queue the next read from the client */
+   WsLibRead (wsptr,
+              clptr->InputBuffer,
+              sizeof(clptr->InputBuffer),
+              PtdReadClient);
 }
 
 /*****************************************************************************/
 /*
-Write the supplied data to the PTD (i.e. to the system).
+Write the supplied data to the PTD (i.e. to the system).  If a write is already
+in progress append it to the input queue (PtdWriteAst() will write it).
 */
 
 void PtdWrite
@@ -980,9 +1472,19 @@ int DataCount
    /* begin */
    /*********/
 
+   if (DataCount < 0) DataCount = strlen(DataPtr);
+
+   if (clptr->PtdQueuedWrite)
+   {
+      sptr = clptr->InputQueue + clptr->InputQueueCount;
+      zptr = clptr->InputQueue + sizeof(clptr->InputQueue);
+      for (cptr = DataPtr; DataCount-- && sptr < zptr; *sptr++ = *cptr++);
+      clptr->InputQueueCount = sptr - clptr->InputQueue;
+      return;
+   }
+
    sptr = bptr = clptr->PtdWriteBuffer + sizeof(short)+sizeof(short);
    zptr = sptr + sizeof(clptr->PtdWriteBuffer) - sizeof(short)-sizeof(short);
-   if (DataCount < 0) DataCount = strlen(DataPtr);
    for (cptr = DataPtr; DataCount-- && sptr < zptr; *sptr++ = *cptr++);
    clptr->PtdWriteCount = sptr - bptr;
 
@@ -993,7 +1495,9 @@ int DataCount
 
 /*****************************************************************************/
 /*
-PTD write (to system) has completed.  If OK read from the WebSocket client.
+PTD write (to system) has completed.  If OK write any client input queued in
+the meantime (all of it in the one PTD write) and resume reading from the
+WebSocket client if that had been paused by a full queue.
 */
 
 void PtdWriteAst (struct PtdClient *clptr)
@@ -1008,15 +1512,53 @@ void PtdWriteAst (struct PtdClient *clptr)
    if (clptr->PtdQueuedWrite) clptr->PtdQueuedWrite--;
 
    status = *(short*)clptr->PtdWriteBuffer;
-   if (VMSok(status) ||
-       status == SS$_DATAOVERUN ||
-       status == SS$_DATALOST)
+   if (VMSnok(status) &&
+       status != SS$_DATAOVERUN &&
+       status != SS$_DATALOST)
+   {
+      clptr->InputQueueCount = 0;
+      PtdClose (clptr);
+      return;
+   }
+
+   if (clptr->InputQueueCount) PtdReadClientQueue (clptr);
+
+   if (clptr->InputPaused)
+   {
+      clptr->InputPaused = 0;
       WsLibRead (clptr->WsLibPtr,
                  clptr->InputBuffer,
                  sizeof(clptr->InputBuffer),
                  PtdReadClient);
-   else
-      PtdClose (clptr);
+   }
+}
+
+/*****************************************************************************/
+/*
+Write client input queued while the previous PTD write was in progress.
+Consecutive client messages are merged into the one PTD write.
+*/
+
+void PtdReadClientQueue (struct PtdClient *clptr)
+
+{
+   int  cnt;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   cnt = clptr->InputQueueCount;
+   if (cnt > sizeof(clptr->PtdWriteBuffer) - sizeof(short)-sizeof(short))
+      cnt = sizeof(clptr->PtdWriteBuffer) - sizeof(short)-sizeof(short);
+
+   PtdWrite (clptr, clptr->InputQueue, cnt);
+
+   clptr->InputQueueCount -= cnt;
+   if (clptr->InputQueueCount)
+      memmove (clptr->InputQueue,
+               clptr->InputQueue + cnt,
+               clptr->InputQueueCount);
 }
 
 /*****************************************************************************/
@@ -1057,6 +1599,15 @@ int DataCount
 
       AdviseClientTermSize (clptr);
    }
+   else
+   if (!memcmp (cptr, BinaryEscape, sizeof(BinaryEscape)-1))
+   {
+      /* binary transport, terminal bytes sent and received unconverted */
+      WsLibSetBinary (clptr->WsLibPtr);
+      /* acknowledge (as binary), the JavaScript then sends binary */
+      WsLibWrite (clptr->WsLibPtr, BinaryEscape,
+                  sizeof(BinaryEscape)-1, WSLIB_ASYNCH);
+   }
 }
 
 /*****************************************************************************/
@@ -1095,37 +1646,38 @@ void AdviseClientTermSize (struct PtdClient *clptr)
 /*
 Logical name value DCLINABOX_ENABLE controls whether this script can be used. 
 Make the value "*" to allow all remote hosts.  Alternatively provide one or
-more comma-separated, dotted-decimal IP address to specify one or more hosts
-allowed to use the script, and/or one or more comman-separated IP addresses and
-CIDR subnet mask to specify a range of hosts.  IPv4 only!
+more comma-separated, IPv4 dotted-decimal or IPv6 address to specify one or
+more hosts allowed to use the script, and/or one or more comman-separated IP
+addresses and CIDR subnet mask to specify a range of hosts.  The value is
+compiled by EnableCompile() and only recompiled when the configuration
+snapshot (see ConfigLoad()) changes.
 */
 
 int DCLinaboxEnable ()
 
 {
-   unsigned int  IPaddr, IPnet, mask;
-   char  ch;
-   char  *aptr, *cptr, *sptr, *zptr;
+   char  *aptr, *cptr, *sptr;
+   unsigned char  IpAddr [16];
 
    /*********/
    /* begin */
    /*********/
 
-   if (!(cptr = SysTrnLnm (EnableLogicalName, NULL, 0)))
+   if (!(cptr = ConfigPtr->EnablePtr))
    {
       fprintf (stdout, "Status: 403 \"%s\" undefined\r\n\r\n",
                EnableLogicalName);
       exit (1);
    }
 
-   if (!(aptr = WsLibCgiVarNull("REMOTE_ADDR"))) return (0);
-   /* inet_aton() is not available on VMS V7.2 */
-   IPaddr = inet_addr (aptr);
-   if (IPaddr == 0xffffffff) return (0);
+   if (EnableGeneration != ConfigPtr->Generation) EnableCompile (cptr);
 
-   if (!strstr (cptr, "ws:"))
+   if (!(aptr = WsLibCgiInfo()->RemoteAddr)) return (0);
+   if (!IpAddressParse (aptr, IpAddr)) return (0);
+
+   if (!EnableClear)
    {
-      if (!(sptr = WsLibCgiVarNull ("REQUEST_SCHEME"))) return (0);
+      if (!(sptr = WsLibCgiInfo()->RequestScheme)) return (0);
       if (strcmp(sptr,"wss:") && strcmp(sptr,"https:"))
       {
          fprintf (stdout, "Status: 403 Must be SSL\r\n\r\n");
@@ -1133,31 +1685,9 @@ int DCLinaboxEnable ()
       }
    }
 
-   if (strchr (cptr, '*')) return (1);
+   if (EnableAll) return (1);
 
-   while (*cptr && *sptr)
-   {
-      while (*cptr && *cptr != ',') cptr++;
-      if (ch = *cptr) *cptr = '\0';
-      if (zptr = strchr (sptr, '/'))
-      {
-         /* subnet mask */
-         *zptr = '\0';
-         /* inet_aton() is not available on VMS V7.2 */
-         IPnet = inet_addr (sptr);
-         if (IPnet == 0xffffffff) return (0);
-         mask = atoi(zptr+1);
-         mask = 0xffffffff >> (32 - mask); 
-         /* if both addresses are valid and masked client address matches */
-         if (IPaddr && IPnet && (IPnet == (IPaddr & mask))) return (1);
-         *zptr = '/';
-      }
-      else
-      if (!strcmp (sptr, aptr))
-         return (1);
-      if (*cptr = ch) cptr++;
-      sptr = cptr;
-   }
+   if (EnableAllowed (IpAddr)) return (1);
 
    fprintf (stdout, "Status: 403 Not Permitted\r\n\r\n");
 
@@ -1166,36 +1696,267 @@ int DCLinaboxEnable ()
 
 /*****************************************************************************/
 /*
-See description in code prologue.  Returns SS$_NORMAL if single sign-on has
-been validated and should be performed, SS$_NOMOREITEMS (still a success
-status) if DCLinabox without SSO is permitted, and SS$_INVLOGIN if DCLinabox
-usage is not permitted without SSO.
+Compile the DCLINABOX_ENABLE value into a binary trie of address prefixes. 
+IPv4 addresses are held as IPv4-mapped IPv6 (::ffff:a.b.c.d) so the one trie
+serves both.  A host address is a prefix of the full address length.  An
+entry that cannot be parsed is ignored (it will match nothing).  The "*" and
+"ws:" entries are noted as flags.
 */
 
-int DCLinaboxSingleSignOn (struct PtdClient *clptr)
+void EnableCompile (char *EnableValue)
 
 {
-   static unsigned long  SysPrvMask [2] = { PRV$M_SYSPRV, 0 };
-   static unsigned long  UaiFlags;
-   static unsigned long  UaiPriv [2];
-   static struct {
-      short int  buf_len;
-      short int  item;
-      void  *buf_addr;
-      unsigned short  *ret_len;
-   } UaiItems [] =
+   int  bits, length;
+   char  *cptr, *sptr, *zptr;
+   unsigned char  IpAddr [16];
+   char  Entry [128];
+
+   /*********/
+   /* begin */
+   /*********/
+
+   EnableGeneration = ConfigPtr->Generation;
+
+   EnableClear = (strstr (EnableValue, "ws:") != NULL);
+   EnableAll = (strchr (EnableValue, '*') != NULL);
+
+   if (!EnableNodeSize)
    {
-      { sizeof(UaiFlags), UAI$_FLAGS, &UaiFlags, 0 },
-      { sizeof(UaiPriv), UAI$_PRIV, &UaiPriv, 0 },
-      { 0,0,0,0 }
-   };
-   static $DESCRIPTOR (UserNameDsc, "");
+      EnableNodeSize = 256;
+      EnableNodePtr = calloc (EnableNodeSize, sizeof(struct EnableNode));
+      if (!EnableNodePtr) EXIT_FI_LI (vaxc$errno);
+   }
+   /* the root node */
+   memset (EnableNodePtr, 0, sizeof(struct EnableNode));
+   EnableNodeCount = 1;
+
+   cptr = EnableValue;
+   while (*cptr)
+   {
+      zptr = (sptr = Entry) + sizeof(Entry)-1;
+      while (*cptr && *cptr != ',' && sptr < zptr) *sptr++ = *cptr++;
+      *sptr = '\0';
+      while (*cptr && *cptr != ',') cptr++;
+      if (*cptr) cptr++;
+
+      if (sptr = strchr (Entry, '/')) *sptr++ = '\0';
+      if (!(length = IpAddressParse (Entry, IpAddr))) continue;
+      if (sptr)
+      {
+         if (!isdigit(*sptr)) continue;
+         bits = atoi(sptr);
+         if (bits > length) continue;
+         /* IPv4 prefixes follow the 96 bits of the mapped address */
+         if (length == 32) bits += 96;
+      }
+      else
+         bits = 128;
+      EnableInsert (IpAddr, bits);
+   }
+}
+
+/*****************************************************************************/
+/*
+Add the address prefix of 'PrefixBits' length to the trie.
+*/
+
+void EnableInsert
+(
+unsigned char *IpAddr,
+int PrefixBits
+)
+{
+   int  bit, idx, node;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   node = 0;
+   for (bit = 0; bit < PrefixBits; bit++)
+   {
+      idx = (IpAddr[bit>>3] >> (7 - (bit & 7))) & 1;
+      if (!EnableNodePtr[node].Child[idx])
+      {
+         if (EnableNodeCount >= EnableNodeSize)
+         {
+            EnableNodeSize *= 2;
+            EnableNodePtr = realloc (EnableNodePtr,
+                                     EnableNodeSize * sizeof(struct EnableNode));
+            if (!EnableNodePtr) EXIT_FI_LI (vaxc$errno);
+         }
+         memset (&EnableNodePtr[EnableNodeCount], 0, sizeof(struct EnableNode));
+         EnableNodePtr[node].Child[idx] = EnableNodeCount++;
+      }
+      node = EnableNodePtr[node].Child[idx];
+   }
+   EnableNodePtr[node].Allow = 1;
+}
+
+/*****************************************************************************/
+/*
+Return true if any prefix in the trie matches the address.  At most one node
+per address bit is visited whatever the number of entries.
+*/
+
+int EnableAllowed (unsigned char *IpAddr)
+
+{
+   int  bit, node;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   node = 0;
+   for (bit = 0; ; bit++)
+   {
+      if (EnableNodePtr[node].Allow) return (1);
+      if (bit >= 128) return (0);
+      node = EnableNodePtr[node].Child[(IpAddr[bit>>3] >> (7 - (bit & 7))) & 1];
+      if (!node) return (0);
+   }
+}
+
+/*****************************************************************************/
+/*
+Parse an IPv4 dotted-decimal or IPv6 (RFC 4291 text form, including "::"
+compression and a trailing dotted-decimal) address into the 16 byte buffer,
+IPv4 as IPv4-mapped IPv6.  Return the length in bits of the address as given
+(32 or 128) or zero if it cannot be parsed.  (inet_pton() is not available on
+VMS V7.2).
+*/
+
+int IpAddressParse
+(
+char *AddrPtr,
+unsigned char *IpAddr
+)
+{
+   int  cnt, gap, len, val;
+   char  *cptr;
 
-   int  idx, ptatus, status,
-        NotUserName = 0;
+   /*********/
+   /* begin */
+   /*********/
+
+   memset (IpAddr, 0, 16);
+
+   if (!strchr (AddrPtr, ':'))
+   {
+      if (!IpAddress4Parse (AddrPtr, IpAddr+12)) return (0);
+      IpAddr[10] = IpAddr[11] = 0xff;
+      return (32);
+   }
+
+   cnt = 0;
+   gap = -1;
+   cptr = AddrPtr;
+   if (*cptr == ':')
+   {
+      if (*(cptr+1) != ':') return (0);
+      gap = 0;
+      cptr += 2;
+   }
+
+   while (*cptr)
+   {
+      if (cnt >= 8) return (0);
+      if (strchr (cptr, '.') && !strchr (cptr, ':'))
+      {
+         /* trailing dotted-decimal (e.g. ::ffff:192.168.1.2) */
+         if (cnt > 6) return (0);
+         if (!IpAddress4Parse (cptr, IpAddr+cnt*2)) return (0);
+         cnt += 2;
+         break;
+      }
+      for (len = val = 0; isxdigit(*cptr); cptr++, len++)
+         val = val * 16 + (isdigit(*cptr) ? *cptr - '0' :
+                                            tolower(*cptr) - 'a' + 10);
+      if (!len || len > 4) return (0);
+      IpAddr[cnt*2] = val >> 8;
+      IpAddr[cnt*2+1] = val & 0xff;
+      cnt++;
+      if (!*cptr) break;
+      if (*cptr++ != ':') return (0);
+      if (*cptr == ':')
+      {
+         if (gap >= 0) return (0);
+         gap = cnt;
+         cptr++;
+      }
+      else
+      if (!*cptr)
+         return (0);
+   }
+
+   if (gap < 0)
+   {
+      if (cnt != 8) return (0);
+   }
+   else
+   {
+      if (cnt > 7) return (0);
+      /* move the groups following the "::" to the end, zeroes between */
+      memmove (IpAddr + 16 - (cnt-gap)*2, IpAddr + gap*2, (cnt-gap)*2);
+      memset (IpAddr + gap*2, 0, 16 - cnt*2);
+   }
+
+   return (128);
+}
+
+/*****************************************************************************/
+/*
+Parse a dotted-decimal IPv4 address into the 4 byte buffer.  Return true if
+valid.  (inet_aton() is not available on VMS V7.2).
+*/
+
+int IpAddress4Parse
+(
+char *AddrPtr,
+unsigned char *IpAddr
+)
+{
+   int  idx, val;
+   char  *cptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   cptr = AddrPtr;
+   for (idx = 0; idx < 4; idx++)
+   {
+      if (!isdigit(*cptr)) return (0);
+      for (val = 0; isdigit(*cptr); cptr++)
+         if ((val = val * 10 + *cptr - '0') > 255) return (0);
+      IpAddr[idx] = val;
+      if (idx < 3 && *cptr++ != '.') return (0);
+   }
+   return (*cptr == '\0');
+}
+
+/*****************************************************************************/
+/*
+See description in code prologue.  Returns SS$_NORMAL if single sign-on has
+been validated and should be performed, SS$_NOMOREITEMS (still a success
+status) if DCLinabox without SSO is permitted, and SS$_INVLOGIN if DCLinabox
+usage is not permitted without SSO.
+*/
+
+int DCLinaboxSingleSignOn (struct PtdClient *clptr)
+
+{
+   int  status,
+        AllowAt = 0,
+        DenyAt = 0;
+   unsigned long  UaiFlags;
+   unsigned long  UaiPriv [2];
    char  *cptr, *sptr, *zptr,
          *AuthRealm,
          *RemoteUser;
+   struct SsoRealm  *rlptr;
+   struct SsoUser  *upptr;
    struct WsLibStruct  *wsptr;
 
    /*********/
@@ -1218,111 +1979,400 @@ int DCLinaboxSingleSignOn (struct PtdClient *clptr)
       if (!*AuthRealm) return (SS$_NOMOREITEMS);
    }
 
-   if (!(RemoteUser = WsLibCgiVarNull("WWW_REMOTE_USER")))
+   if (!(RemoteUser = WsLibCgiInfo()->RemoteUser))
       return (SS$_NOMOREITEMS);
    if (!*RemoteUser) return (SS$_NOMOREITEMS);
 
-   UserNameDsc.dsc$a_pointer = RemoteUser;
-   UserNameDsc.dsc$w_length = strlen(RemoteUser);
-
    wsptr = clptr->WsLibPtr;
 
-   for (idx = 0; idx <= 127; idx++)
+   /* recompiled only if the configuration has changed */
+   if (SsoGeneration != ConfigPtr->Generation)
+      SsoCompile (wsptr, ConfigPtr->SsoPtr);
+
+   for (rlptr = SsoRealmList; rlptr; rlptr = rlptr->NextPtr)
+      if (!strcasecmp (rlptr->RealmName, AuthRealm)) break;
+   if (!rlptr) return (SS$_NOMOREITEMS);
+
+   for (upptr = rlptr->UserHash[SsoHash(RemoteUser) & (SSO_HASH_SIZE-1)];
+        upptr;
+        upptr = upptr->NextPtr)
+      if (!strcasecmp (upptr->UserName, RemoteUser)) break;
+   if (upptr)
    {
-      if (!(cptr = SysTrnLnm (SingleLogicalName, NULL, idx))) break;
+      AllowAt = upptr->AllowAt;
+      DenyAt = upptr->DenyAt;
+   }
+
+   WsLibWatchScript (wsptr, FI_LI, "\"!AZ\" \"!AZ\" allow:!UL deny:!UL \
+wild:!UL!AZ!AZ!AZ", AuthRealm, RemoteUser, AllowAt, DenyAt, rlptr->WildAt,
+                     rlptr->WildType & SSO_WILD_NOT ? " !" : " ",
+                     rlptr->WildType & SSO_WILD ? "*" : "",
+                     rlptr->WildType & SSO_WILD_PRIV ? "*" : "");
 
-      WsLibWatchScript (wsptr, FI_LI, "\"!AZ\"", cptr);
-      for (sptr = cptr; *sptr && *sptr != '='; sptr++);
-      if (*sptr) *sptr++ = '\0';
+   /* the first of a username or a wildcard (in value order) decides */
+   if (AllowAt && rlptr->WildAt && rlptr->WildAt < AllowAt) AllowAt = 0;
+   if (!AllowAt && !rlptr->WildAt) return (SS$_NOMOREITEMS);
+
+   /* check the account status */
+   status = UaiLookup (wsptr, RemoteUser, &UaiFlags, UaiPriv);
+   if (VMSnok (status))
+   {
+      WsLibWatchScript (wsptr, FI_LI, "$GETUAI %X!8XL", status);
+      return (SS$_NOMOREITEMS);
+   }
 
-      /* if the realm name does not match then look for the next */
-      WsLibWatchScript (wsptr, FI_LI, "\"!AZ\" \"!AZ\"", AuthRealm, cptr);
-      if (!*cptr || strcasecmp (cptr, AuthRealm)) continue;
+   if (UaiFlags & UAI$M_DISACNT)
+   {
+      WsLibWatchScript (wsptr, FI_LI, "UAI flags !8XL", UaiFlags);
+      return (SS$_NOMOREITEMS);
+   }
 
-      while (*cptr)
+   if (!AllowAt)
+   {
+      /* wildcard match ('**' allows privileged) */
+      if (!(rlptr->WildType & SSO_WILD_PRIV))
       {
-         for (cptr = sptr; *sptr && *sptr != ','; sptr++);
-         if (!*cptr) break;
-         if (*sptr) *sptr++ = '\0';
-         if (!*cptr) continue;
+         /* check for vanilla user */
+         if ((UaiPriv[0] & ~(PRV$M_NETMBX | PRV$M_TMPMBX)) || UaiPriv[1])
+         {
+            WsLibWatchScript (wsptr, FI_LI, "UAI priv !8XL !8XL",
+                              UaiPriv[0], UaiPriv[1]);
+            return (SS$_NOMOREITEMS);
+         }
+      }
+
+      /* only available to SSO */
+      if (rlptr->WildType & SSO_WILD_NOT) return (SS$_INVLOGIN);
 
-         WsLibWatchScript (wsptr, FI_LI, "\"!AZ\" \"!AZ\"", RemoteUser, cptr);
+      /* a preceding '!username' */
+      if (DenyAt && DenyAt < rlptr->WildAt) return (SS$_NOMOREITEMS);
+   }
 
-         if (*cptr == '!') cptr++;
+   zptr = (sptr = clptr->VmsUserName) + sizeof(clptr->VmsUserName)-1;
+   for (cptr = RemoteUser; *cptr && sptr < zptr; *sptr++ = *cptr++);
+   if (sptr > zptr)
+   {
+      /* hmmm, something's askew! */
+      clptr->VmsUserName[0] = '\0';
+      return (SS$_RESULTOVF);
+   }
+   *sptr = '\0';
+   return (SS$_NORMAL);
+}
 
-         if (strcasecmp (cptr, RemoteUser) && *cptr != '*') continue;
+/*****************************************************************************/
+/*
+Compile the (newline-separated) DCLINABOX_SSO values into a list of realms,
+each with a hash of the usernames it names and the first wildcard it
+contains.  Each username records the position (in value order, within the
+realm) of its first allow ('username') and first deny ('!username') so the
+original first-match semantics are preserved.  As previously, an empty
+comma-separated entry (or a lone '!') ends processing of that value.
+*/
+
+void SsoCompile
+(
+struct WsLibStruct *wsptr,
+char *ValuePtr
+)
+{
+   int  hash, negate, position;
+   char  *cptr, *sptr, *vptr;
+   struct SsoRealm  *rlptr;
+   struct SsoUser  *upptr;
 
-         /* check the account status */
-         ptatus = sys$setprv (1, &SysPrvMask, 0, 0);
-         if (VMSnok (ptatus)) EXIT_FI_LI(ptatus);
+   /*********/
+   /* begin */
+   /*********/
 
-         status = sys$getuai (0, 0, &UserNameDsc, &UaiItems, 0, 0, 0);
+   SsoGeneration = ConfigPtr->Generation;
 
-         ptatus = sys$setprv (0, &SysPrvMask, 0, 0);
-         if (VMSnok (ptatus)) EXIT_FI_LI(ptatus);
+   /* SSO configuration changed, so might have the accounts */
+   UaiCachePurge ();
 
-         if (VMSnok (status))
+   while (rlptr = SsoRealmList)
+   {
+      SsoRealmList = rlptr->NextPtr;
+      for (hash = 0; hash < SSO_HASH_SIZE; hash++)
+         while (upptr = rlptr->UserHash[hash])
          {
-            WsLibWatchScript (wsptr, FI_LI, "$GETUAI %X!8XL", status);
-            return (SS$_NOMOREITEMS);
+            rlptr->UserHash[hash] = upptr->NextPtr;
+            free (upptr);
          }
+      free (rlptr);
+   }
 
-         if (UaiFlags & UAI$M_DISACNT)
-         {
-            WsLibWatchScript (wsptr, FI_LI, "UAI flags !8XL", UaiFlags);
-            return (SS$_NOMOREITEMS);
-         }
+   for (vptr = ValuePtr; *vptr; vptr = *cptr ? cptr+1 : cptr)
+   {
+      /* end of this value */
+      for (cptr = vptr; *cptr && *cptr != '\n'; cptr++);
+
+      WsLibWatchScript (wsptr, FI_LI, "\"!#AZ\"", cptr - vptr, vptr);
 
-         /* wildcard match (allows privileged) */
-         if (*(USHORTPTR)cptr == '**') break;
+      /* realm name */
+      for (sptr = vptr; sptr < cptr && *sptr != '='; sptr++);
+      if (sptr == vptr || *sptr != '=') continue;
 
-         /* if the user name matches */
-         if (!strcasecmp (cptr, RemoteUser))
+      for (rlptr = SsoRealmList; rlptr; rlptr = rlptr->NextPtr)
+         if (strlen(rlptr->RealmName) == sptr - vptr &&
+             !strncasecmp (rlptr->RealmName, vptr, sptr - vptr)) break;
+      if (!rlptr)
+      {
+         /* structure and name allocated together */
+         rlptr = calloc (1, sizeof(struct SsoRealm) + (sptr - vptr) + 1);
+         if (!rlptr) EXIT_FI_LI (vaxc$errno);
+         rlptr->RealmName = (char*)(rlptr+1);
+         strncpy (rlptr->RealmName, vptr, sptr - vptr);
+         rlptr->NextPtr = SsoRealmList;
+         SsoRealmList = rlptr;
+      }
+
+      /* usernames and wildcards */
+      for (vptr = sptr+1; vptr < cptr; vptr = sptr+1)
+      {
+         for (sptr = vptr; *sptr && *sptr != ',' && *sptr != '\n'; sptr++);
+         position = ++rlptr->EntryCount;
+
+         if (negate = (*vptr == '!')) vptr++;
+         /* (an empty entry, or a lone '!', ends the value) */
+         if (vptr == sptr) break;
+
+         if (*vptr == '*')
          {
-            if (*(cptr-1) == '!')
-            {
-               NotUserName = 1;
-               continue;
-            }
-            NotUserName = 0;
-            break;
+            /* only the first wildcard can be reached */
+            if (rlptr->WildAt) continue;
+            rlptr->WildAt = position;
+            rlptr->WildType = SSO_WILD;
+            if (sptr - vptr > 1 && *(vptr+1) == '*')
+               rlptr->WildType |= SSO_WILD_PRIV;
+            if (negate) rlptr->WildType |= SSO_WILD_NOT;
+            continue;
          }
 
-         /* check for vanilla user */
-         if ((UaiPriv[0] & ~(PRV$M_NETMBX | PRV$M_TMPMBX)) || UaiPriv[1])
+         hash = SsoHash (vptr) & (SSO_HASH_SIZE-1);
+         for (upptr = rlptr->UserHash[hash]; upptr; upptr = upptr->NextPtr)
+            if (strlen(upptr->UserName) == sptr - vptr &&
+                !strncasecmp (upptr->UserName, vptr, sptr - vptr)) break;
+         if (!upptr)
          {
-            WsLibWatchScript (wsptr, FI_LI, "UAI priv !8XL !8XL",
-                              UaiPriv[0], UaiPriv[1]);
-            return (SS$_NOMOREITEMS);
+            upptr = calloc (1, sizeof(struct SsoUser) + (sptr - vptr) + 1);
+            if (!upptr) EXIT_FI_LI (vaxc$errno);
+            upptr->UserName = (char*)(upptr+1);
+            strncpy (upptr->UserName, vptr, sptr - vptr);
+            upptr->NextPtr = rlptr->UserHash[hash];
+            rlptr->UserHash[hash] = upptr;
          }
-
-         break;
+         if (negate)
+         {
+            if (!upptr->DenyAt) upptr->DenyAt = position;
+         }
+         else
+         if (!upptr->AllowAt)
+            upptr->AllowAt = position;
       }
+   }
+}
+
+/*****************************************************************************/
+/*
+Case-insensitive hash of the username (up to any comma or newline).
+*/
+
+unsigned int SsoHash (char *NamePtr)
 
-      if (*cptr) break;
+{
+   unsigned int  hash;
+   char  *cptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   hash = 0;
+   for (cptr = NamePtr; *cptr && *cptr != ',' && *cptr != '\n'; cptr++)
+      hash = hash * 31 + toupper(*cptr);
+   return (hash);
+}
+
+/*****************************************************************************/
+/*
+Return the UAI flags and privileges of the account.  Lookups are cached (by
+username) for DCLINABOX_UAI_CACHE seconds (zero disables) with the least
+recently used entry reused when the cache is full.  Only successful lookups
+are cached.  Returns the sys$getuai() status (or success if cached).
+*/
+
+int UaiLookup
+(
+struct WsLibStruct *wsptr,
+char *UserName,
+unsigned long *FlagsPtr,
+unsigned long *PrivPtr
+)
+{
+   static unsigned long  SysPrvMask [2] = { PRV$M_SYSPRV, 0 };
+   static unsigned long  UaiFlags;
+   static unsigned long  UaiPriv [2];
+   static struct {
+      short int  buf_len;
+      short int  item;
+      void  *buf_addr;
+      unsigned short  *ret_len;
+   } UaiItems [] =
+   {
+      { sizeof(UaiFlags), UAI$_FLAGS, &UaiFlags, 0 },
+      { sizeof(UaiPriv), UAI$_PRIV, &UaiPriv, 0 },
+      { 0,0,0,0 }
+   };
+   static $DESCRIPTOR (UserNameDsc, "");
+
+   int  hash, ptatus, secs, status;
+   unsigned int  now;
+   struct UaiCache  *ucptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   secs = ConfigPtr->UaiCacheSecs;
+   if (secs != UaiCacheSecs)
+   {
+      UaiCacheSecs = secs;
+      UaiCachePurge ();
    }
 
-   if (cptr && *cptr && *(cptr-1) != '!' && !NotUserName)
+   now = WsLibTime();
+   hash = SsoHash (UserName) & (UAI_CACHE_HASH-1);
+
+   if (UaiCacheSecs > 0)
    {
-      zptr = (sptr = clptr->VmsUserName) + sizeof(clptr->VmsUserName)-1;
-      for (cptr = RemoteUser; *cptr && sptr < zptr; *sptr++ = *cptr++);
-      if (sptr > zptr)
+      for (ucptr = UaiCacheHash[hash]; ucptr; ucptr = ucptr->HashNextPtr)
+         if (!strcasecmp (ucptr->UserName, UserName)) break;
+      if (ucptr && now - ucptr->CacheTime < UaiCacheSecs)
       {
-         /* hmmm, something's askew! */
-         clptr->VmsUserName[0] = '\0';
-         return (SS$_RESULTOVF);
+         /* to the head of the least-recently-used list */
+         if (ucptr != UaiCacheLruHead)
+         {
+            ucptr->LruPrevPtr->LruNextPtr = ucptr->LruNextPtr;
+            if (ucptr->LruNextPtr)
+               ucptr->LruNextPtr->LruPrevPtr = ucptr->LruPrevPtr;
+            else
+               UaiCacheLruTail = ucptr->LruPrevPtr;
+            ucptr->LruPrevPtr = NULL;
+            ucptr->LruNextPtr = UaiCacheLruHead;
+            UaiCacheLruHead->LruPrevPtr = ucptr;
+            UaiCacheLruHead = ucptr;
+         }
+         WsLibWatchScript (wsptr, FI_LI, "UAI cached !UL", now -
+                           ucptr->CacheTime);
+         *FlagsPtr = ucptr->UaiFlags;
+         PrivPtr[0] = ucptr->UaiPriv[0];
+         PrivPtr[1] = ucptr->UaiPriv[1];
+         return (SS$_NORMAL);
       }
-      *sptr = '\0';
-      return (SS$_NORMAL);
+      /* expired */
+      if (ucptr) UaiCacheUnlink (ucptr);
    }
 
-   if (cptr && *(USHORTPTR)(cptr-1) == '!*')
+   UserNameDsc.dsc$a_pointer = UserName;
+   UserNameDsc.dsc$w_length = strlen(UserName);
+
+   ptatus = sys$setprv (1, &SysPrvMask, 0, 0);
+   if (VMSnok (ptatus)) EXIT_FI_LI(ptatus);
+
+   status = sys$getuai (0, 0, &UserNameDsc, &UaiItems, 0, 0, 0);
+
+   ptatus = sys$setprv (0, &SysPrvMask, 0, 0);
+   if (VMSnok (ptatus)) EXIT_FI_LI(ptatus);
+
+   if (VMSnok (status)) return (status);
+
+   *FlagsPtr = UaiFlags;
+   PrivPtr[0] = UaiPriv[0];
+   PrivPtr[1] = UaiPriv[1];
+
+   if (UaiCacheSecs <= 0) return (status);
+   if (strlen(UserName) >= sizeof(ucptr->UserName)) return (status);
+
+   if (ucptr = UaiCacheFreePtr)
+      UaiCacheFreePtr = ucptr->HashNextPtr;
+   else
+   if (UaiCacheCount < UAI_CACHE_MAX)
+      ucptr = &UaiCachePool[UaiCacheCount++];
+   else
    {
-      /* only available to SSO */
-      return (SS$_INVLOGIN);
+      /* reuse the least recently used */
+      UaiCacheUnlink (ucptr = UaiCacheLruTail);
+      UaiCacheFreePtr = ucptr->HashNextPtr;
    }
 
-   return (SS$_NOMOREITEMS);
+   strcpy (ucptr->UserName, UserName);
+   ucptr->CacheTime = now;
+   ucptr->UaiFlags = UaiFlags;
+   ucptr->UaiPriv[0] = UaiPriv[0];
+   ucptr->UaiPriv[1] = UaiPriv[1];
+
+   ucptr->HashNextPtr = UaiCacheHash[hash];
+   UaiCacheHash[hash] = ucptr;
+
+   ucptr->LruPrevPtr = NULL;
+   if (ucptr->LruNextPtr = UaiCacheLruHead)
+      UaiCacheLruHead->LruPrevPtr = ucptr;
+   else
+      UaiCacheLruTail = ucptr;
+   UaiCacheLruHead = ucptr;
+
+   return (status);
+}
+
+/*****************************************************************************/
+/*
+Empty the cache.
+*/
+
+void UaiCachePurge ()
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   memset (UaiCacheHash, 0, sizeof(UaiCacheHash));
+   UaiCacheLruHead = UaiCacheLruTail = UaiCacheFreePtr = NULL;
+   UaiCacheCount = 0;
+}
+
+/*****************************************************************************/
+/*
+Remove the entry from its hash chain and the least-recently-used list and put
+it on the free list.
+*/
+
+void UaiCacheUnlink (struct UaiCache *ucptr)
+
+{
+   struct UaiCache  **ucpptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   for (ucpptr = &UaiCacheHash[SsoHash(ucptr->UserName) & (UAI_CACHE_HASH-1)];
+        *ucpptr && *ucpptr != ucptr;
+        ucpptr = &(*ucpptr)->HashNextPtr);
+   if (*ucpptr) *ucpptr = ucptr->HashNextPtr;
+
+   if (ucptr->LruPrevPtr)
+      ucptr->LruPrevPtr->LruNextPtr = ucptr->LruNextPtr;
+   else
+      UaiCacheLruHead = ucptr->LruNextPtr;
+   if (ucptr->LruNextPtr)
+      ucptr->LruNextPtr->LruPrevPtr = ucptr->LruPrevPtr;
+   else
+      UaiCacheLruTail = ucptr->LruPrevPtr;
+
+   ucptr->HashNextPtr = UaiCacheFreePtr;
+   UaiCacheFreePtr = ucptr;
 }
 
 /*****************************************************************************/
@@ -1343,6 +2393,7 @@ void SessionManagement ()
    static unsigned long  DviOwnUic,
                          DviPid;
    static int  AlertMsgLen,
+               ConfigGeneration,
                IdleMins,
                WarnMins;
    static unsigned short  DviHostNameLen,
@@ -1350,10 +2401,11 @@ void SessionManagement ()
    static int  GetPrcNam = 1,
                WaitForIt;
    static char  *WarnMsgPtr;
+   static struct WsLibPrepStruct  *AlertPrepPtr,
+                                  *WarnPrepPtr;
    static char  AlertMsg [sizeof(AlertEscape)+256],
                 DviDevNam [64+1],
                 DviHostName [8+1],
-                IdleLogicalValue [256],
                 IdentString [64],
                 JpiPrcNam [15+1];
    static $DESCRIPTOR (UicFaoDsc, "!%I\0");
@@ -1400,36 +2452,27 @@ void SessionManagement ()
    else
       WaitForIt = 4;
 
-   if (!WaitForIt)
+   /* the snapshot may also have been replaced by a connection (ENABLE/SSO) */
+   ConfigLoad ();
+
+   if (ConfigGeneration != ConfigPtr->Generation)
    {
-      /****************/
-      /* every minute */
-      /****************/
+      ConfigGeneration = ConfigPtr->Generation;
+
+      /********************/
+      /* settings changed */
+      /********************/
 
       /* idle session management can be changed at any point */
-      IdleMins = WarnMins = 0;
-      WarnMsgPtr = NULL;
-      if (cptr = SysTrnLnm (IdleLogicalName, IdleLogicalValue, 0))
-      {
-         IdleMins = atoi(cptr);
-         while (*cptr && *cptr != ',') cptr++;
-         if (*cptr) cptr++;
-         WarnMins = atoi(cptr);
-         while (*cptr && *cptr != ',') cptr++;
-         if (*cptr) cptr++;
-         if (!*(WarnMsgPtr = cptr)) WarnMsgPtr = DEFAULT_WARN_MESSAGE;
-      }
-      /* defining idle minutes to -1 disables idle session management */
-      if (IdleMins >= 0)
-      {
-         if (!IdleMins) IdleMins = DEFAULT_IDLE_MINS;
-         if (!WarnMins) WarnMins = DEFAULT_WARN_MINS;
-         if (IdleMins <= WarnMins) IdleMins = WarnMins + DEFAULT_WARN_MINS;
-         if (!WarnMsgPtr) WarnMsgPtr = DEFAULT_WARN_MESSAGE;
-      }
+      IdleMins = ConfigPtr->IdleMins;
+      WarnMins = ConfigPtr->WarnMins;
+      WarnMsgPtr = ConfigPtr->WarnMsgPtr;
+      /* (re)prepared when next required */
+      WsLibMsgRelease (WarnPrepPtr);
+      WarnPrepPtr = NULL;
 
       /* check for the presence of an ALERT logical name and value */
-      if (aptr = SysTrnLnm (AlertLogicalName, NULL, 0))
+      if (aptr = ConfigPtr->AlertPtr)
       {
          if (!AlertMsg[0] || strcmp (aptr, AlertMsg+sizeof(AlertEscape)-1))
          {
@@ -1445,10 +2488,18 @@ void SessionManagement ()
             while (*aptr && sptr < zptr) *sptr++ = *aptr++;
             *sptr = '\0';
             AlertMsgLen = sptr - AlertMsg;
+            /* encoded and framed once for all sessions */
+            WsLibMsgRelease (AlertPrepPtr);
+            AlertPrepPtr = WsLibMsgPrepare (AlertMsg, AlertMsgLen,
+                                            WSLIB_OPCODE_TEXT);
          }
       }
       else
+      {
          AlertMsg[0] = '\0';
+         WsLibMsgRelease (AlertPrepPtr);
+         AlertPrepPtr = NULL;
+      }
    }
 
    /****************/
@@ -1585,19 +2636,25 @@ void SessionManagement ()
       if (clptr->WarnTime && clptr->WarnTime < CurrentTime)
       {
          clptr->WarnTime = 0;
-         zptr = (sptr = EscapeBuffer) + sizeof(EscapeBuffer)-16;
-         for (cptr = AlertEscape; *cptr && sptr < zptr; *sptr++ = *cptr++);
-         for (cptr = WarnMsgPtr;
-              *cptr && *(USHORTPTR)cptr != '%d' && sptr < zptr;
-              *sptr++ = *cptr++);
-         if (*(USHORTPTR)cptr == '%d')
+         if (!WarnPrepPtr)
          {
-            cptr += 2;
-            sprintf (sptr, "%d", WarnMins);
-            while (*sptr && sptr < zptr) sptr++;
-            while (*cptr && sptr < zptr) *sptr++ = *cptr++;
+            /* the same for all sessions until the settings are next read */
+            zptr = (sptr = EscapeBuffer) + sizeof(EscapeBuffer)-16;
+            for (cptr = AlertEscape; *cptr && sptr < zptr; *sptr++ = *cptr++);
+            for (cptr = WarnMsgPtr;
+                 *cptr && *(USHORTPTR)cptr != '%d' && sptr < zptr;
+                 *sptr++ = *cptr++);
+            if (*(USHORTPTR)cptr == '%d')
+            {
+               cptr += 2;
+               sprintf (sptr, "%d", WarnMins);
+               while (*sptr && sptr < zptr) sptr++;
+               while (*cptr && sptr < zptr) *sptr++ = *cptr++;
+            }
+            WarnPrepPtr = WsLibMsgPrepare (EscapeBuffer, sptr-EscapeBuffer,
+                                           WSLIB_OPCODE_TEXT);
          }
-         WsLibWrite (wsptr, EscapeBuffer, sptr-EscapeBuffer, WSLIB_ASYNCH);
+         WsLibWritePrepared (wsptr, WarnPrepPtr, WSLIB_ASYNCH);
 
          /* avoid banging out an alert message at the same time */
          continue;
@@ -1610,7 +2667,7 @@ void SessionManagement ()
       if (AlertMsg[0] && !clptr->Alerted)
       {
          clptr->Alerted = 1;
-         WsLibWrite (clptr->WsLibPtr, AlertMsg, AlertMsgLen, WSLIB_ASYNCH);
+         WsLibWritePrepared (clptr->WsLibPtr, AlertPrepPtr, WSLIB_ASYNCH);
       }
    }
 
@@ -1618,6 +2675,261 @@ void SessionManagement ()
    if (VMSnok(status)) EXIT_FI_LI (status);
 }
 
+/*****************************************************************************/
+/*
+Called for each connection.  Translate only the access control logical names
+(DCLINABOX_ENABLE and DCLINABOX_SSO) and compare them with the snapshot's, so
+that (for example) removing an address or username applies to the very next
+connection.  If either has changed reload the full configuration.  The others
+are left to the fifteen second SessionManagement() reload.  Returns true if
+the configuration has changed.
+*/
+
+int ConfigAccess ()
+
+{
+   static int  AccessNames [] = { CONFIG_ENABLE, CONFIG_SSO, -1 };
+   static char  Values [CONFIG_ACCESS_MAX];
+
+   int  idx, len;
+   char  *sptr, *zptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!ConfigPtr) return (ConfigLoad ());
+
+   zptr = Values + sizeof(Values)-1;
+   for (idx = 0; AccessNames[idx] >= 0; idx++)
+   {
+      sptr = ConfigTranslate (AccessNames[idx], Values, zptr);
+      len = ConfigPtr->ValueOffset[AccessNames[idx]+1] -
+            ConfigPtr->ValueOffset[AccessNames[idx]];
+      if (sptr - Values != len ||
+          memcmp (Values, ConfigPtr->Values +
+                          ConfigPtr->ValueOffset[AccessNames[idx]], len))
+         return (ConfigLoad ());
+   }
+
+   return (0);
+}
+
+/*****************************************************************************/
+/*
+Read all the DCLinabox logical names into the one buffer and if it differs
+from the current configuration snapshot parse it into a new one, replacing
+(and freeing) the current.  A snapshot is never modified once in use, so
+settings (and any pointers into them) are consistent for the duration of any
+one use, and the connection path neither parses nor (apart from the access
+control names, see ConfigAccess()) translates logical names.  Called at
+startup and every fifteen seconds by SessionManagement().  Returns true if the
+configuration has changed.
+*/
+
+int ConfigLoad ()
+
+{
+   static int  Generation;
+   static char  Values [CONFIG_VALUES_MAX];
+
+   int  idx, len;
+   char  *aptr, *cptr, *sptr, *vptr, *zptr;
+   char  AlertMsg [sizeof(AlertEscape)+256];
+   struct DCLinaboxConfig  *cfptr;
+   struct WsLibPrepStruct  *prepptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   /* each value as "=value\n", each logical name ended by a form-feed */
+   zptr = (sptr = Values) + sizeof(Values)-1;
+   for (idx = 0; idx < CONFIG_COUNT; idx++)
+      sptr = ConfigTranslate (idx, sptr, zptr);
+   *sptr = '\0';
+   len = sptr - Values;
+
+   if (ConfigPtr && !strcmp (Values, ConfigPtr->Values)) return (0);
+
+   /* the values, a copy to be parsed, and announcement lines (\r\n) */
+   cfptr = calloc (1, sizeof(struct DCLinaboxConfig) + len * 3 + 3);
+   if (!cfptr) EXIT_FI_LI (vaxc$errno);
+   memcpy (cfptr->Values, Values, len+1);
+   cptr = cfptr->Values + len + 1;
+   memcpy (cptr, Values, len+1);
+   aptr = cfptr->AnnouncePtr = cptr + len + 1;
+
+   for (vptr = cptr, idx = 0; idx < CONFIG_COUNT; idx++)
+   {
+      cfptr->ValueOffset[idx] = cptr - vptr;
+      for (sptr = cptr; *cptr && *cptr != '\f'; cptr++);
+      if (*cptr) *cptr++ = '\0';
+
+      /* multi-valued */
+      if (idx == CONFIG_ANNOUNCE)
+      {
+         /* each value less its leading '=' and with carriage-control */
+         for (zptr = sptr; *zptr; zptr++)
+         {
+            for (zptr++; *zptr && *zptr != '\n'; *aptr++ = *zptr++);
+            *aptr++ = '\r';
+            *aptr++ = '\n';
+         }
+         cfptr->AnnounceLength = aptr - cfptr->AnnouncePtr;
+         continue;
+      }
+      if (idx == CONFIG_SSO)
+      {
+         /* newline-separated values (each less its leading '=') */
+         for (cfptr->SsoPtr = zptr = sptr; *sptr; sptr++)
+         {
+            for (sptr++; *sptr && *sptr != '\n'; *zptr++ = *sptr++);
+            *zptr++ = '\n';
+         }
+         *zptr = '\0';
+         continue;
+      }
+
+      /* single-valued, NULL if not defined */
+      if (*sptr == '=')
+      {
+         for (zptr = ++sptr; *zptr && *zptr != '\n'; zptr++);
+         *zptr = '\0';
+      }
+      else
+         sptr = NULL;
+
+      switch (idx)
+      {
+         case CONFIG_ALERT :
+            cfptr->AlertPtr = sptr;
+            break;
+
+         case CONFIG_COALESCE :
+            /* period terminal output is coalesced (zero disables) */
+            if (sptr)
+               cfptr->CoalesceMsecs = atoi(sptr);
+            else
+               cfptr->CoalesceMsecs = DEFAULT_COALESCE_MSECS;
+            if (cfptr->CoalesceMsecs < 0) cfptr->CoalesceMsecs = 0;
+            if (cfptr->CoalesceMsecs > 100) cfptr->CoalesceMsecs = 100;
+            break;
+
+         case CONFIG_DEFLATE :
+            /* permessage-deflate window bits (zero disables) */
+            if (sptr) cfptr->DeflateBits = atoi(sptr);
+            break;
+
+         case CONFIG_ENABLE :
+            cfptr->EnablePtr = sptr;
+            break;
+
+         case CONFIG_IDLE :
+            if (sptr)
+            {
+               cfptr->IdleMins = atoi(sptr);
+               while (*sptr && *sptr != ',') sptr++;
+               if (*sptr) sptr++;
+               cfptr->WarnMins = atoi(sptr);
+               while (*sptr && *sptr != ',') sptr++;
+               if (*sptr) sptr++;
+               if (*sptr) cfptr->WarnMsgPtr = sptr;
+            }
+            /* defining idle minutes to -1 disables idle session management */
+            if (cfptr->IdleMins >= 0)
+            {
+               if (!cfptr->IdleMins) cfptr->IdleMins = DEFAULT_IDLE_MINS;
+               if (!cfptr->WarnMins) cfptr->WarnMins = DEFAULT_WARN_MINS;
+               if (cfptr->IdleMins <= cfptr->WarnMins)
+                  cfptr->IdleMins = cfptr->WarnMins + DEFAULT_WARN_MINS;
+            }
+            if (!cfptr->WarnMsgPtr) cfptr->WarnMsgPtr = DEFAULT_WARN_MESSAGE;
+            break;
+
+         case CONFIG_UAI_CACHE :
+            if (sptr)
+               cfptr->UaiCacheSecs = atoi(sptr);
+            else
+               cfptr->UaiCacheSecs = DEFAULT_UAI_CACHE_SECS;
+            break;
+      }
+   }
+
+   /* the connect-time preamble, each escape remaining a discrete message */
+   cfptr->PreamblePtr = WsLibMsgAppend (NULL, VersionEscape,
+                                        sizeof(VersionEscape)-1,
+                                        WSLIB_OPCODE_TEXT);
+   if (aptr = cfptr->AlertPtr)
+   {
+      zptr = (sptr = AlertMsg) + sizeof(AlertMsg)-1;
+      for (cptr = AlertEscape; *cptr && sptr < zptr; *sptr++ = *cptr++);
+      while (*aptr && sptr < zptr) *sptr++ = *aptr++;
+      prepptr = WsLibMsgAppend (cfptr->PreamblePtr, AlertMsg, sptr-AlertMsg,
+                                WSLIB_OPCODE_TEXT);
+      WsLibMsgRelease (cfptr->PreamblePtr);
+      cfptr->PreamblePtr = prepptr;
+   }
+   if (cfptr->AnnounceLength)
+      cfptr->SsoPreamblePtr = WsLibMsgAppend (cfptr->PreamblePtr,
+                                              cfptr->AnnouncePtr,
+                                              cfptr->AnnounceLength,
+                                              WSLIB_OPCODE_TEXT);
+
+   cfptr->ValueOffset[CONFIG_COUNT] = len;
+
+   cfptr->Generation = ++Generation;
+   if (ConfigPtr)
+   {
+      /* writes in progress hold their own reference */
+      WsLibMsgRelease (ConfigPtr->PreamblePtr);
+      WsLibMsgRelease (ConfigPtr->SsoPreamblePtr);
+      free (ConfigPtr);
+   }
+   ConfigPtr = cfptr;
+
+   return (1);
+}
+
+/*****************************************************************************/
+/*
+Translate the configuration logical name 'ConfigIndex' (CONFIG_..) into the
+buffer at 'sptr' (not beyond 'zptr') with each value as "=value\n" and ended
+by a form-feed.  Returns a pointer to the end of the translated values.
+*/
+
+char* ConfigTranslate
+(
+int ConfigIndex,
+char *sptr,
+char *zptr
+)
+{
+   static char  *ConfigNames [] = { AlertLogicalName, AnnounceLogicalName,
+                                    CoalesceLogicalName, DeflateLogicalName,
+                                    EnableLogicalName, IdleLogicalName,
+                                    SingleLogicalName, UaiCacheLogicalName };
+
+   int  ldx;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   for (ldx = 0; ldx <= 127 && zptr - sptr > 256+2; ldx++)
+   {
+      if (!SysTrnLnm (ConfigNames[ConfigIndex], sptr+1, ldx)) break;
+      *sptr = '=';
+      while (*sptr) sptr++;
+      *sptr++ = '\n';
+      /* only these are multi-valued */
+      if (ConfigIndex != CONFIG_ANNOUNCE && ConfigIndex != CONFIG_SSO) break;
+   }
+   if (sptr < zptr) *sptr++ = '\f';
+
+   return (sptr);
+}
+
 /*****************************************************************************/
 /*
 Translate a logical name using LNM$FILE_DEV.  Returns a pointer to the value
@@ -77,6 +77,23 @@ dynamic buffer remains allocated and must be grabbed and then explicitly freed
 by the in-line code after the I/O completes.
 
 
+PERMESSAGE-DEFLATE
+------------------
+When compiled with the macro WSLIB_ZLIB defined (and linked against zlib) the
+RFC 7692 permessage-deflate extension is available.  It is disabled by default
+and enabled for subsequently created WebSockets using WsLibSetDeflate().  The
+WebSocket upgrade is performed by the server, which provides any client offer
+as the CGI variable HTTP_SEC_WEBSOCKET_EXTENSIONS, with wsLIB's acceptance
+returned as a header of the "101 Switching Protocols" response.  Compressed
+messages are inflated (and if text validated) before delivery and written
+messages of WSLIB_DEFLATE_MIN bytes or more compressed, transparently to the
+application.  Compression history carries across messages unless no context
+takeover is negotiated.  Each WebSocket's zlib state requires approximately
+256kB (with a 15 bit window) and so fewer window bits reduces memory usage.
+
+  WsLibSetDeflate (<window-bits>, <no-context-takeover>);
+
+
 BASE FRAMING PROTOCOL
 ---------------------
 http://tools.ietf.org/html/draft-ietf-hybi-thewebsocketprotocol-10
@@ -126,6 +143,19 @@ struct WsLibStruct* WsLibNext (struct WsLibStruct **WsLibCtx)
    modification (i.e. use within AST delivery or with ASTs disabled).
 
 
+unsigned long WsLibHandle (struct WsLibStruct *wsptr)
+
+   Return a 32 bit handle for the websocket.  Unlike the structure pointer a
+   handle can be held (e.g. across timers or queued work) and later checked
+   for validity using WsLibFromHandle().
+
+
+struct WsLibStruct* WsLibFromHandle (unsigned long Handle)
+
+   Return the websocket structure pointer for the handle, or NULL if that
+   websocket no longer exists (the handle is stale).
+
+
 int WsLibMsgDsc (struct WsLibStruct *wsptr,
                  struct dsc$descriptor_s *MsgDsc);
 
@@ -235,11 +265,92 @@ char* WsLibReadGrab (struct WsLibStruct *wsptr)
    resource of the grabber.  Must be WsLibFree()ed when no longer required.
 
 
+int WsLibReadIov (struct WsLibStruct *wsptr,
+                  int DataMax,
+                  void *AstFunction)
+
+   Read a message from the websocket delivering it as a list of the
+   (unmasked) frame data buffers, without coalescing fragments into a single
+   buffer.  If DataMax is non-zero it limits the total message size.  Text
+   is delivered as received (UTF-8), see WsLibReadIovFlatten().  When the read
+   completes WsLibReadCount() returns the total message size and the fragment
+   list can be accessed using WsLibReadIovCount(), WsLibReadIovData() and
+   WsLibReadIovLength().  For asynchronous I/O the list is automatically freed
+   after AST delivery, for synchronous I/O it remains until the next read or
+   WsLibReadIovFree().
+
+
+int WsLibReadIovCount (struct WsLibStruct *wsptr)
+
+   Return the number of fragment buffers in the most recent WsLibReadIov().
+
+
+char* WsLibReadIovData (struct WsLibStruct *wsptr,
+                        int IovIndex)
+
+   Return a pointer to the zero-based indexed fragment buffer (or NULL).
+
+
+int WsLibReadIovLength (struct WsLibStruct *wsptr,
+                        int IovIndex)
+
+   Return the length of the zero-based indexed fragment buffer (or zero).
+
+
+char* WsLibReadIovFlatten (struct WsLibStruct *wsptr,
+                           int *CountPtr)
+
+   Copy the fragment list into a single, null-terminated, contiguous buffer,
+   converting text to 8 bit ASCII if WsLibSetAscii().  If 'CountPtr' is
+   supplied it is set to the resulting data length.  Returns a pointer to the
+   buffer (or NULL if an error) which must be WsLibFree()ed when no longer
+   required.
+
+
+void WsLibReadIovFree (struct WsLibStruct *wsptr)
+
+   Free the fragment list of the most recent WsLibReadIov().
+
+
+int WsLibReadStream (struct WsLibStruct *wsptr,
+                     void *StreamFunction,
+                     void *AstFunction)
+
+   Read a message from the websocket delivering the (unmasked) data to the
+   'StreamFunction' as each chunk (of up to the mailbox size) is read.  The
+   message is never held in memory and so is not limited in size.  Frame
+   lengths greater than 2^32 are accepted (except on VAX).  Text is converted
+   to 8 bit ASCII if WsLibSetAscii().  The stream function is called with the
+   parameters (struct WsLibStruct *wsptr, char *DataPtr, int DataCount).
+   When the message is complete the AST function is called (or the blocking
+   read returns) and WsLibReadStreamTotal() provides the message size.
+
+
+unsigned long* WsLibReadStreamTotal (struct WsLibStruct *wsptr)
+
+   Return a pointer to a quadword containing the number of bytes delivered by
+   the most recent WsLibReadStream().
+
+
 unsigned long* WsLibReadTotal (struct WsLibStruct *wsptr)
 
    Return a pointer to a quadword containing the total number of bytes read.
 
 
+void WsLibPoolStats (struct WsLibStruct *wsptr,
+                     unsigned long *AllocCountPtr,
+                     unsigned long *ReuseCountPtr)
+
+   Set the number of wsLIB internal allocations made, and the number of times
+   a pooled message structure or buffer was reused instead, for the WebSocket.
+
+
+unsigned long* WsLibReadIoTotal (struct WsLibStruct *wsptr)
+
+   Return a pointer to a quadword containing the total number of read $QIOs.
+   Input is buffered and multiple frames parsed from each read.
+
+
 void WsLibResetMsg (struct WsLibStruct *wsptr)
 
    Reset the latest message data.
@@ -250,6 +361,24 @@ unsigned int WsLibTime ();
    Return the current wsLIB time in seconds (i.e. C-RTL, Unix time).
 
 
+int WsLibTimerAdd (struct WsLibTimerStruct *TimerPtr,
+                   int Msecs,
+                   void *AstFunction,
+                   void *AstParam)
+
+   Arm (or re-arm) the caller-supplied timer structure to call the function
+   with the parameter (AstFunction(AstParam)) after 'Msecs' milliseconds.  The
+   structure must be zeroed before first use and remain valid while armed.
+   Timers are one-shot (re-add from the function for periodic behaviour).
+   All timers, including the per-websocket watchdog deadlines, are held in
+   the one min-heap and the process wakes only when the earliest is due.
+
+
+int WsLibTimerCancel (struct WsLibTimerStruct *TimerPtr)
+
+   Disarm the timer.  Returns true if it was armed, false if not (or fired).
+
+
 int WsLibWrite (struct WsLibStruct *wsptr,
                 char *DataPtr,
                 int DataCount,
@@ -262,6 +391,57 @@ int WsLibWrite (struct WsLibStruct *wsptr,
    If DataPtr is NULL then a close is sent to the websocket.
 
 
+int WsLibWriteHeadroom (struct WsLibStruct *wsptr,
+                        char *DataPtr,
+                        int DataCount,
+                        int HeadroomCount,
+                        void *AstFunction)
+
+   As for WsLibWrite() but the caller guarantees 'HeadroomCount' bytes of
+   storage immediately preceding 'DataPtr' may be overwritten.  When the frame
+   header fits into that space the header and data are written using a single
+   $QIO.  A server role frame of up to 65535 bytes requires 4 bytes headroom,
+   larger 10 bytes, and client role (masked) frames are always copied.
+
+
+struct WsLibPrepStruct* WsLibMsgPrepare (char *DataPtr,
+                                         int DataCount,
+                                         int Opcode)
+
+   Encode and frame a message once so that it can be written to any number of
+   websockets using WsLibWritePrepared().  'Opcode' is WSLIB_OPCODE_TEXT (8 bit
+   data converted to UTF-8) or WSLIB_OPCODE_BINARY (opaque).  The prepared
+   message is reference counted and the caller's reference must be released
+   using WsLibMsgRelease() when no longer required (it is freed when the last
+   write using it completes).  Returns NULL if the opcode is not supported.
+
+
+struct WsLibPrepStruct* WsLibMsgAppend (struct WsLibPrepStruct *PrepPtr,
+                                        char *DataPtr,
+                                        int DataCount,
+                                        int Opcode)
+
+   Prepare a message (as for WsLibMsgPrepare()) and return a new block holding
+   the frame(s) of 'PrepPtr' followed by the new frame.  The block is written
+   by WsLibWritePrepared() as the one (server role only) $QIO and arrives as
+   that many separate messages.  'PrepPtr' may be NULL, and is not released.
+
+
+int WsLibWritePrepared (struct WsLibStruct *wsptr,
+                        struct WsLibPrepStruct *PrepPtr,
+                        void *AstFunction)
+
+   As for WsLibWrite() but the data is a prepared message.  For a server role
+   websocket the prepared frame is written as-is using a single $QIO, with no
+   per-write scan, conversion, compression, or allocation.  Client role
+   (masked) and fragmented writes frame a copy as usual.
+
+
+void WsLibMsgRelease (struct WsLibPrepStruct *PrepPtr)
+
+   Release a reference to a prepared message (see WsLibMsgPrepare()).
+
+
 int WsLibWriteDsc (struct WsLibStruct *wsptr,
                    struct dsc$descriptor_s *DataDsc,
                    void *AstFunction)
@@ -411,6 +591,59 @@ void* WsLibSetWakeCallback (struct WsLibStruct *wsptr,
    Set the number of seconds between wakeup calls (zero defaults).
 
 
+void WsLibSetOutputLimit (struct WsLibStruct *wsptr,
+                          int ByteLimit,
+                          int MsgLimit)
+
+   Set the high-water marks for the WebSocket's queued (incomplete) output.
+   Zero is no limit.  When either is reached the WebSocket is no longer
+   writable and WSLIB_ASYNCH writes (which have no completion AST to pace the
+   application) that would exceed a limit are refused with SS$_EXQUOTA.
+   It becomes writable again when both have drained to half the limit.
+
+
+void* WsLibSetWritableCallback (struct WsLibStruct *wsptr,
+                                void *CallbackFunction)
+
+   Set/reset the function called (with the WebSocket pointer) when output that
+   had reached a high-water mark has drained.
+   Returns the previous callback pointer.
+
+
+int WsLibIsWritable (struct WsLibStruct *wsptr)
+
+   Return true if the WebSocket's queued output is below the high-water marks.
+
+
+int WsLibOutputQueued (struct WsLibStruct *wsptr,
+                       int *MsgCountPtr)
+
+   Return the number of bytes of queued (incomplete) output.  If 'MsgCountPtr'
+   is supplied set it to the number of queued messages.
+
+
+void WsLibSetDeflate (int WindowBits,
+                      int NoContextTakeover)
+
+   Accept any client permessage-deflate offer for subsequently created
+   WebSockets.  'WindowBits' (9 to 15) is the maximum compression window, zero
+   disables.  If 'NoContextTakeover' is true compression history is reset for
+   each message.  Requires wsLIB to be compiled with WSLIB_ZLIB.
+
+
+int WsLibSetDeflateLevel (struct WsLibStruct *wsptr,
+                          int Level)
+
+   Set the compression level (1 to 9) for permessage-deflate output.  Zero
+   sends messages uncompressed.  If a WebSocket is not specified then set
+   global value.  Returns SS$_UNSUPPORTED if not negotiated for the WebSocket.
+
+
+int WsLibIsDeflate (struct WsLibStruct *wsptr)
+
+   Return true if permessage-deflate was negotiated for the WebSocket.
+
+
 int WsLibFromUtf8 (char *UtfPtr,
                    int UtfCount,
                    char SubsChar)
@@ -476,13 +709,45 @@ This is free software, and you are welcome to redistribute it under the
 conditions of the GNU GENERAL PUBLIC LICENSE, version 3, or any later version.
 http://www.gnu.org/licenses/gpl.txt
 
-Function WsLib__Utf8Legal() contains code ...
+Function WsLib__Utf8Decode() contains code ...
 Copyright (c) 2008-2009 Bjoern Hoehrmann <bjoern@hoehrmann.de>
 See http://bjoern.hoehrmann.de/utf-8/decoder/dfa/ for details.
 
 
 VERSION HISTORY
 ---------------
+16-OCT-2026  AGT  v1.1.0, buffered input reads multiple frames per $QIO
+                          WsLibReadIoTotal() number of read $QIOs
+                          WsLibReadIov() delivers uncoalesced fragments
+                          WsLib__Mask() word-at-a-time masking kernel
+                          WsLib__Utf8Decode() single-pass unmask, validate
+                            and decode (replaces WsLib__Utf8Legal())
+                          bugfix; WsLibFromUtf8() 3 and 4 byte sequences
+                          pooled message structures and buffers
+                          bugfix; client role masked UTF-8 double free
+                          WsLibReadStream() deliver data to a sink function
+                          WsLibWriteHeadroom() header and data single $QIO
+                          WsLibSetOutputLimit(), WsLibSetWritableCallback(),
+                            WsLibIsWritable(), WsLibOutputQueued()
+                          WsLib__Utf8Count() and WsLib__Utf8Encode() word
+                            at a time 8 bit to UTF-8 (write and ToUtf8())
+                          permessage-deflate (RFC 7692) with WSLIB_ZLIB,
+                            WsLibSetDeflate(), WsLibSetDeflateLevel(),
+                            WsLibIsDeflate()
+                          WsLib__MaskingKey() xoshiro128** key blocks
+                          client role masks internal buffers in-situ
+                          WsLibMsgPrepare(), WsLibWritePrepared(),
+                            WsLibMsgRelease() pre-framed shared messages
+                          WsLibTimerAdd(), WsLibTimerCancel() millisecond
+                            timers, min-heap replaces per-second list walk
+                          websocket structures from a slab, doubly-linked
+                            list, WsLibHandle(), WsLibFromHandle()
+                          WATCH log records buffered, written and fsync()ed
+                            in batches (WsLib__WatchDrain()), drop when full
+                          CGIplus variables hash indexed at request sync,
+                            WsLibCgiInfo() for commonly used variables
+                          CGIplus 'records' mode buffer expands as required
+                          WsLibMsgAppend() block of pre-framed messages
 08-DEC-2012  MGD  tidied some #includes
 23-SEP-2012  MGD  v1.0.4, "clean"-up response to client close
 15-AUG-2012  MGD  v1.0.3, refine WRITEOF and channel destruction
@@ -507,7 +772,7 @@ VERSION HISTORY
 #endif /* COMMENTS_WITH_COMMENTS */
 /*****************************************************************************/
 
-#define SOFTWAREVN "1.0.4"
+#define SOFTWAREVN "1.1.0"
 #define SOFTWARENM "WSLIB"
 #ifdef __ALPHA
 #  define SOFTWAREID SOFTWARENM " AXP-" SOFTWAREVN
@@ -534,6 +799,10 @@ VERSION HISTORY
 #include <stsdef.h>
 #include <unixlib.h>
 
+#ifdef WSLIB_ZLIB
+#  include <zlib.h>
+#endif
+
 #include "wslib.h"
 
 /* from libmsg.h */
@@ -551,6 +820,16 @@ VERSION HISTORY
 
 #define FI_LI "WSLIB", __LINE__
 
+/* machine word used by the masking kernel */
+#ifdef __VAX
+#  define WSLIB_MASK_WORD unsigned long
+#else
+#  define WSLIB_MASK_WORD unsigned __int64
+#endif
+
+/* masking keys generated per block (see WsLib__MaskingKey()) */
+#define WSLIB_MASK_KEYS 64
+
 #if 1
 #define WATCH_WSLIB if(wsptr->WatchScript)WsLibWatchScript
 #else
@@ -569,6 +848,40 @@ static unsigned long  CurrentTime,
                       WatchDogWakeTime;
 static unsigned long  CurrentBinTime [2];
 
+/* timer min-heap, one-based (see WsLibTimerAdd()) */
+static int  TimerHeapCount,
+            TimerHeapSize,
+            TimerInAst,
+            TimerScheduled,
+            WatchLogCount;
+static unsigned int  TimerScheduledMsecs;
+static struct WsLibTimerStruct  **TimerHeapPtr;
+static struct WsLibTimerStruct  ClockTimer;
+
+/* millisecond times wrap (after 49 days) so compare by difference */
+#define WSLIB_MSECS_BEFORE(a,b) ((int)((a)-(b)) < 0)
+
+/* watchdog deadlines beyond this (seconds) are re-armed when reached */
+#define WSLIB_WATCHDOG_MAX_SECS 86400
+
+/* CGIplus variable index (see WsLib__CgiIndex()) */
+static int  CgiIndexCount,
+            CgiIndexSize,
+            CgiInfoValid;
+static char  **CgiIndexPtr;
+static struct WsLibCgiStruct  CgiInfo;
+
+/* WATCH log records buffered for writing (power of two bytes) */
+#define WSLIB_WATCH_RING_SIZE 65536
+#define WSLIB_WATCH_ALIGN(n) (((n) + 7) & ~7)
+
+static int  WatchDrainQueued,
+            WatchDraining;
+static unsigned long  WatchDropCount,
+                      WatchRingIn,
+                      WatchRingOut;
+static char  *WatchRingPtr;
+
 #define DEFAULT_WATCHDOG_CLOSE_SECS  5
 #define DEFAULT_WATCHDOG_IDLE_SECS 120
 #define DEFAULT_WATCHDOG_LIFE_SECS 120
@@ -576,6 +889,11 @@ static unsigned long  CurrentBinTime [2];
 #define DEFAULT_WATCHDOG_READ_SECS  60
 #define DEFAULT_WATCHDOG_WAKE_SECS  60
 
+/* permessage-deflate (see WsLibSetDeflate()) */
+static int  DeflateLevel = WSLIB_DEFLATE_LEVEL,
+            DeflateNoContext = 0,
+            DeflateWindowBits = 0;
+
 static unsigned long  WatchDogCloseSecs = DEFAULT_WATCHDOG_CLOSE_SECS,
                       WatchDogIdleSecs = DEFAULT_WATCHDOG_IDLE_SECS,
                       WatchDogLifeSecs = DEFAULT_WATCHDOG_LIFE_SECS,
@@ -589,6 +907,12 @@ static char  *CgiPlusEofPtr = NULL,
 
 static struct WsLibStruct *WsLibListHead; 
 
+/* websocket structure slab, slot table indexed by handle (one-based) */
+static int  SlabCount,
+            SlabSize;
+static struct WsLibStruct  *SlabFreePtr;
+static struct WsLibStruct  **SlabTablePtr;
+
 static void  (*PongCallbackFunction)(),
              (*WakeCallbackFunction)();
 
@@ -682,6 +1006,8 @@ void *DestroyFunction
    int  astatus,
         SecWebSocketVersion;
    char  *cptr, *sptr;
+   char  Extensions [256];
+   struct WsLibCgiStruct  *ciptr;
    struct WsLibStruct  *wsptr;
 
    /*********/
@@ -692,30 +1018,24 @@ void *DestroyFunction
 
    astatus = sys$setast (0); 
 
-   wsptr = (struct WsLibStruct*) calloc (1, sizeof(struct WsLibStruct));
-   if (!wsptr) WsLibExit (NULL, FI_LI, vaxc$errno);
+   wsptr = WsLib__SlabGet ();
 
    if (cptr = getenv ("WASD_WSLIB_WATCH_LOG"))
       if (!(wsptr->WatchLog = fopen (cptr, "w", "shr=get")))
          WsLibExit (NULL, FI_LI, vaxc$errno);
+      else
+         WatchLogCount++;
 
    /* if a scripting application running under the server */
-   if (WsLibCgiVarNull ("SERVER_SOFTWARE"))
+   if ((ciptr = WsLibCgiInfo())->ServerSoftware)
    {
-      if (cptr = WsLibCgiVarNull("WEBSOCKET_INPUT_MRS"))
-         wsptr->InputMrs = atoi(cptr);
-      else
+      if (!(wsptr->InputMrs = ciptr->InputMrs))
          WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
 
-      if (cptr = WsLibCgiVarNull("WEBSOCKET_OUTPUT_MRS"))
-         wsptr->OutputMrs = atoi(cptr);
-      else
-         WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
-
-      if (!(cptr = WsLibCgiVarNull("HTTP_SEC_WEBSOCKET_VERSION")))
+      if (!(wsptr->OutputMrs = ciptr->OutputMrs))
          WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
 
-      SecWebSocketVersion = atoi(cptr);
+      SecWebSocketVersion = ciptr->WebSocketVersion;
       if (SecWebSocketVersion <= 0) WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
 
       /* this logical name is also detected by the WASD server */
@@ -738,14 +1058,23 @@ Sec-Websocket-Version: %s\r\n\
 \r\n",
                   WSLIB_WEBSOCKET_VERSION);
          fflush (stdout);
-         free (wsptr);
+         WsLib__SlabPut (wsptr);
+         if (astatus == SS$_WASSET) sys$setast (1);
          return (NULL);
       }
 
       wsptr->WebSocketVersion = SecWebSocketVersion;
 
+      Extensions[0] = '\0';
+#ifdef WSLIB_ZLIB
+      /* accept any offered permessage-deflate (if enabled) */
+      if (DeflateWindowBits)
+         WsLib__DeflateOffer (wsptr, Extensions);
+#endif
+
       /* connection acceptance response */
-      fprintf (stdout, "Status: 101 Switching Protocols\r\n\r\n");
+      fprintf (stdout, "Status: 101 Switching Protocols\r\n%s\r\n",
+               Extensions);
       fflush (stdout);
    }
    else
@@ -760,7 +1089,7 @@ Sec-Websocket-Version: %s\r\n\
    wsptr->FrameMaxSize = 4294967295;
    wsptr->UserDataPtr = UserDataPtr;
    wsptr->DestroyAstFunction = DestroyFunction;
-   wsptr->NextPtr = WsLibListHead;
+   if (wsptr->NextPtr = WsLibListHead) WsLibListHead->PrevPtr = wsptr;
    WsLibListHead = wsptr;
 
    if (astatus == SS$_WASSET) sys$setast (1);
@@ -784,14 +1113,14 @@ void* WsLibDestroy (struct WsLibStruct *wsptr)
 
 /*****************************************************************************/
 /*
-Remove from the list and free the allocated memory.  Return any user data.
+Remove from the list, free the allocated memory and return the structure to
+the slab.
 */
 
 static void WsLib__Destroy (struct WsLibStruct *wsptr)
 
 {
    int  astatus, cnt, status;
-   struct WsLibStruct  *wslptr;
    void  *UserDataPtr;
    FILE  *WatchLog;
 
@@ -808,7 +1137,21 @@ static void WsLib__Destroy (struct WsLibStruct *wsptr)
    astatus = sys$setast (0); 
    UserDataPtr = wsptr->UserDataPtr;
 
+   WsLib__TimerRemove (&wsptr->WatchDogTimer);
+   if (WatchLog)
+   {
+      /* write any buffered records before the log is closed */
+      WsLib__WatchDrain ();
+      WatchLogCount--;
+   }
+
    if (wsptr->InBufferSize) free (wsptr->InBufferPtr);
+   if (wsptr->InputBufSize) free (wsptr->InputBufPtr);
+   if (wsptr->InputIovPtr) WsLibReadIovFree (wsptr);
+#ifdef WSLIB_ZLIB
+   WsLib__DeflateEnd (wsptr);
+#endif
+   WsLib__PoolFree (wsptr);
    if (wsptr->OutBufferSize) free (wsptr->OutBufferPtr);
    if (wsptr->MsgStringSize) free (wsptr->MsgStringPtr);
    if (wsptr->ClientHeaderSize)
@@ -821,18 +1164,16 @@ static void WsLib__Destroy (struct WsLibStruct *wsptr)
       if (wsptr->ClientUriSize) free (wsptr->ClientUriPtr);
    }
 
-   if ((wslptr = WsLibListHead) == wsptr)
-      WsLibListHead = wslptr->NextPtr;
+   if (wsptr->PrevPtr)
+      wsptr->PrevPtr->NextPtr = wsptr->NextPtr;
    else
-   {
-      while (wslptr->NextPtr != wsptr) wslptr = wslptr->NextPtr;
-      wslptr->NextPtr = wsptr->NextPtr;
-   }
+      WsLibListHead = wsptr->NextPtr;
+   if (wsptr->NextPtr) wsptr->NextPtr->PrevPtr = wsptr->PrevPtr;
 
    if (!wsptr->SocketChannel && wsptr->OutputChannel)
       sys$dassgn (wsptr->OutputChannel);
 
-   free (wsptr);
+   WsLib__SlabPut (wsptr);
    if (astatus == SS$_WASSET) sys$setast (1);
 
    if (WatchLog) fclose (WatchLog);
@@ -845,13 +1186,15 @@ to hold the context.  Set to NULL to initialise.  Returns non-null pointers for
 each structure in the list, then NULL when list exhausted, to begin non-null
 pointers again.  Care must be exercised that multiple calls are not preempted
 by a list modification (i.e. use within AST delivery or with ASTs disabled).
+Structures are never returned to the C-RTL (see WsLib__SlabPut()) so the
+context can be checked as still in use without walking the list.
 */
 
 struct WsLibStruct* WsLibNext (struct WsLibStruct **WsLibCtx)
                                                     
 {
    int  astatus;
-   struct WsLibStruct  *wsptr, *wslptr;
+   struct WsLibStruct  *wsptr;
 
    /*********/
    /* begin */
@@ -861,9 +1204,7 @@ struct WsLibStruct* WsLibNext (struct WsLibStruct **WsLibCtx)
    /* let's be overcautious and make sure it's still in the list! */
    if (wsptr = *WsLibCtx)
    {
-      for (wslptr = WsLibListHead; wslptr; wslptr = wslptr->NextPtr)
-         if (wslptr == wsptr) break;
-      if (!wslptr) WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
+      if (!wsptr->SlabInUse) WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
       *WsLibCtx = wsptr->NextPtr;
    }
    else
@@ -872,6 +1213,122 @@ struct WsLibStruct* WsLibNext (struct WsLibStruct **WsLibCtx)
    return (*WsLibCtx);
 }
 
+/*****************************************************************************/
+/*
+Return the handle for the websocket; slot generation in the high word and slot
+index in the low.
+*/
+
+unsigned long WsLibHandle (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return (((wsptr->SlabGeneration & 0xffff) << 16) | wsptr->SlabIndex);
+}
+
+/*****************************************************************************/
+/*
+Return the websocket for the handle, or NULL if the slot is not in use or has
+been reused since the handle was obtained.
+*/
+
+struct WsLibStruct* WsLibFromHandle (unsigned long Handle)
+
+{
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!(Handle & 0xffff) || (Handle & 0xffff) > SlabCount) return (NULL);
+   wsptr = SlabTablePtr[Handle & 0xffff];
+   if (!wsptr->SlabInUse) return (NULL);
+   if ((wsptr->SlabGeneration & 0xffff) != (Handle >> 16)) return (NULL);
+   return (wsptr);
+}
+
+/*****************************************************************************/
+/*
+Allocate a zeroed websocket structure from the slab.  Structures are allocated
+WSLIB_SLAB_CHUNK at a time and each given a permanent slot (index).  Call with
+ASTs disabled.
+*/
+
+static struct WsLibStruct* WsLib__SlabGet ()
+
+{
+   int  idx;
+   unsigned long  SlabGeneration,
+                  SlabIndex;
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!SlabFreePtr)
+   {
+      if (SlabCount + WSLIB_SLAB_CHUNK > WSLIB_SLAB_MAX)
+         WsLibExit (NULL, FI_LI, SS$_INSFMEM);
+
+      if (SlabCount + WSLIB_SLAB_CHUNK >= SlabSize)
+      {
+         SlabSize += WSLIB_SLAB_CHUNK * 16;
+         SlabTablePtr = realloc (SlabTablePtr, SlabSize *
+                                               sizeof(struct WsLibStruct*));
+         if (!SlabTablePtr) WsLibExit (NULL, FI_LI, vaxc$errno);
+      }
+
+      wsptr = calloc (WSLIB_SLAB_CHUNK, sizeof(struct WsLibStruct));
+      if (!wsptr) WsLibExit (NULL, FI_LI, vaxc$errno);
+
+      /* slot zero is never used (so a zero handle is always invalid) */
+      for (idx = 0; idx < WSLIB_SLAB_CHUNK; idx++)
+      {
+         SlabTablePtr[++SlabCount] = wsptr;
+         wsptr->SlabIndex = SlabCount;
+         wsptr->NextPtr = SlabFreePtr;
+         SlabFreePtr = wsptr++;
+      }
+   }
+
+   wsptr = SlabFreePtr;
+   SlabFreePtr = wsptr->NextPtr;
+
+   SlabGeneration = wsptr->SlabGeneration;
+   SlabIndex = wsptr->SlabIndex;
+   memset (wsptr, 0, sizeof(struct WsLibStruct));
+   wsptr->SlabGeneration = SlabGeneration;
+   wsptr->SlabIndex = SlabIndex;
+   wsptr->SlabInUse = 1;
+
+   return (wsptr);
+}
+
+/*****************************************************************************/
+/*
+Return the websocket structure to the slab.  The generation is incremented so
+that any outstanding handle becomes stale.  Call with ASTs disabled.
+*/
+
+static void WsLib__SlabPut (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr->SlabInUse = 0;
+   wsptr->SlabGeneration++;
+   wsptr->NextPtr = SlabFreePtr;
+   wsptr->PrevPtr = NULL;
+   SlabFreePtr = wsptr;
+}
+
 /*****************************************************************************/
 /*
 Using the device names from the CGI variables WEBSOCKET_INPUT and
@@ -896,7 +1353,7 @@ int WsLibOpen (struct WsLibStruct *wsptr)
    wsptr->InputDataDsc.dsc$b_dtype =
       wsptr->OutputDataDsc.dsc$b_dtype = DSC$K_DTYPE_T;
 
-   if (!(cptr = WsLibCgiVarNull("WEBSOCKET_INPUT"))) return (SS$_BUGCHECK);
+   if (!(cptr = WsLibCgiInfo()->WebSocketInput)) return (SS$_BUGCHECK);
    zptr = (sptr = wsptr->InputDevName) + sizeof(wsptr->InputDevName)-1;
    while (*cptr && sptr < zptr) *sptr++ = *cptr++;
    *sptr = '\0';
@@ -906,7 +1363,7 @@ int WsLibOpen (struct WsLibStruct *wsptr)
    wsptr->InputDevDsc.dsc$a_pointer = wsptr->InputDevName;
    wsptr->InputDevDsc.dsc$w_length = sptr - wsptr->InputDevName;
 
-   if (!(cptr = WsLibCgiVarNull("WEBSOCKET_OUTPUT"))) return (SS$_BUGCHECK);
+   if (!(cptr = WsLibCgiInfo()->WebSocketOutput)) return (SS$_BUGCHECK);
    zptr = (sptr = wsptr->OutputDevName) + sizeof(wsptr->OutputDevName)-1;
    while (*cptr && sptr < zptr) *sptr++ = *cptr++;
    *sptr = '\0';
@@ -945,6 +1402,7 @@ int WsLibOpen (struct WsLibStruct *wsptr)
 
    if (wsptr->WatchDogPingSecs)
       wsptr->WatchDogPingTime = CurrentTime + wsptr->WatchDogPingSecs;
+   WsLib__WatchDogArm (wsptr);
 
    WATCH_WSLIB (wsptr, FI_LI, "OPEN !AZ", SOFTWAREID);
 
@@ -968,9 +1426,9 @@ char *StatusString
 {
    static char  DummyBuffer [125];
 
-   int  status,
+   int  hcnt, status,
         FramePayload;
-   unsigned char  *aptr, *cptr, *sptr, *zptr;
+   unsigned char  *cptr, *sptr, *zptr;
    struct WsLibFrmStruct  *frmptr;
    struct WsLibMsgStruct  *msgptr;
 
@@ -989,13 +1447,10 @@ char *StatusString
    }
 
    wsptr->WebSocketClosed = 1;
+   WsLib__WatchDogArm (wsptr);
 
-   /* allocate a pointer plus a structure (freed by WsLib__OutputFreeAst()) */ 
-   aptr = calloc (1, sizeof(struct WsLibStruct*) +
-                     sizeof(struct WsLibFrmStruct));
-   if (!aptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-   *(struct WsLibStruct**)aptr = wsptr;
-   frmptr = (struct WsLibFrmStruct*)(aptr + sizeof(struct WsLibStruct*));
+   /* pooled message structure (released by WsLib__MsgFreeAst()) */ 
+   frmptr = &WsLib__MsgGet(wsptr)->FrameData;
 
    if (!StatusCode)
       StatusCode = WSLIB_CLOSE_NORMAL;
@@ -1024,59 +1479,44 @@ char *StatusString
       }
    }
 
+   hcnt = 2;
    FramePayload = 0;
    frmptr->FrameHeader[0] = WSLIB_BIT_FIN | WSLIB_OPCODE_CLOSE;
    if (wsptr->RoleClient)
    {
-      /* little messier with masking required */
       WsLib__MaskingKey (frmptr);
-      frmptr->FrameHeader[2] = frmptr->MaskingKey[0];
-      frmptr->FrameHeader[3] = frmptr->MaskingKey[1];
-      frmptr->FrameHeader[4] = frmptr->MaskingKey[2];
-      frmptr->FrameHeader[5] = frmptr->MaskingKey[3];
-      if (StatusCode)
-      {
-         int  kcnt = 0;
-         char  *kptr = (char*)frmptr->MaskingKey;
-         frmptr->FrameHeader[6] =
-            ((StatusCode & 0xff00) >> 8) ^ kptr[kcnt++&0x3];
-         frmptr->FrameHeader[7] = (StatusCode & 0xff) ^ kptr[kcnt++&0x3];
-         FramePayload = 2;
-         if (StatusString)
-         {
-            zptr = (sptr = frmptr->FrameHeader + 8) + 123;
-            for (cptr = (unsigned char*)StatusString;
-                 *cptr && sptr < zptr;
-                 *sptr++ = *cptr++ ^ kptr[kcnt++&0x3])
-               FramePayload++;
-         }
-      }
-      frmptr->FrameHeader[1] = frmptr->FrameMaskBit | FramePayload;
-      FramePayload += 6;
+      frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[0];
+      frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[1];
+      frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[2];
+      frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[3];
    }
-   else
+
+   if (StatusCode)
    {
-      if (StatusCode)
+      frmptr->FrameHeader[hcnt] = (StatusCode & 0xff00) >> 8;
+      frmptr->FrameHeader[hcnt+1] = StatusCode & 0xff;
+      FramePayload = 2;
+      if (StatusString)
       {
-         frmptr->FrameHeader[2] = (StatusCode & 0xff00) >> 8;
-         frmptr->FrameHeader[3] = StatusCode & 0xff;
-         FramePayload = 2;
-         if (StatusString)
-         {
-            zptr = (sptr = frmptr->FrameHeader + 4) + 123;
-            for (cptr = (unsigned char*)StatusString;
-                 *cptr && sptr < zptr;
-                 *sptr++ = *cptr++)
-               FramePayload++;
-         }
+         zptr = (sptr = frmptr->FrameHeader + hcnt + 2) + 123;
+         for (cptr = (unsigned char*)StatusString;
+              *cptr && sptr < zptr;
+              *sptr++ = *cptr++)
+            FramePayload++;
       }
-      frmptr->FrameHeader[1] = FramePayload;
-      FramePayload += 2;
    }
 
+   /* if being used as a client then mask the payload in-situ */
+   if (frmptr->FrameMaskBit)
+      WsLib__Mask (frmptr->FrameHeader+hcnt, frmptr->FrameHeader+hcnt,
+                   FramePayload, frmptr->MaskingKey, &frmptr->MaskCount);
+
+   frmptr->FrameHeader[1] = frmptr->FrameMaskBit | FramePayload;
+   FramePayload += hcnt;
+
    status = sys$qio (WsLibEfnNoWait, wsptr->OutputChannel,
                      IO$_WRITELBLK | IO$M_READERCHECK,
-                     0, WsLib__OutputFreeAst, aptr,
+                     0, WsLib__MsgFreeAst, frmptr,
                      frmptr->FrameHeader, FramePayload, 0, 0, 0, 0);
    if (VMSok(status)) wsptr->QueuedOutput++;
 
@@ -1088,9 +1528,7 @@ char *StatusString
       /* receive any close response frame */
       /************************************/
 
-      msgptr = calloc (1, sizeof(struct WsLibMsgStruct));
-      if (!msgptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-      msgptr->WsLibPtr = wsptr;
+      msgptr = WsLib__MsgGet (wsptr);
 
       msgptr->DataMax = 4294967295;
       msgptr->DataPtr = DummyBuffer;
@@ -1170,12 +1608,12 @@ static void WsLib__Close (struct WsLibFrmStruct *frmptr)
    {
       /* send the close opcode */
       wsptr->WebSocketClosed = 1;
+      WsLib__WatchDogArm (wsptr);
 
       WATCH_WSLIB (wsptr, FI_LI, "CLOSE response");
 
-      /* allocate a frame structure (freed by WsLib__CloseFreeAst()) */ 
-      frmptr = (struct WsLibFrmStruct*)calloc(1,sizeof(struct WsLibFrmStruct));
-      if (!frmptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+      /* pooled message structure (released by WsLib__MsgFreeAst()) */ 
+      frmptr = &WsLib__MsgGet(wsptr)->FrameData;
 
       /* close frame header */
       frmptr->FrameHeader[0] = WSLIB_BIT_FIN | WSLIB_OPCODE_CLOSE;
@@ -1184,29 +1622,16 @@ static void WsLib__Close (struct WsLibFrmStruct *frmptr)
       /* send the opcode asynchronously delivering to a specific AST */
       status = sys$qio (WsLibEfnNoWait, wsptr->OutputChannel,
                         IO$_WRITELBLK | IO$M_READERCHECK,
-                        0, WsLib__CloseFreeAst, frmptr,
+                        0, WsLib__MsgFreeAst, frmptr,
                         frmptr->FrameHeader, 2, 0, 0, 0, 0);
+      /* shut will wait for this to complete before destruction */
+      if (VMSok(status)) wsptr->QueuedOutput++;
       /* immediately do the WebSocket shutdown, resulting a "clean" close */
    }
 
    WsLib__Shut (wsptr); 
 }
 
-/*****************************************************************************/
-/*
-Just deallocate the memory containing the close frame from WsLib__Close().
-*/
-
-void WsLib__CloseFreeAst (struct WsLibFrmStruct *frmptr)
-
-{
-   /*********/
-   /* begin */
-   /*********/
-
-   free (frmptr);
-}
-
 /*****************************************************************************/
 /*
 Return true if the WebSocket has been closed.
@@ -1258,6 +1683,7 @@ int WsLib__Shut (struct WsLibStruct *wsptr)
 
       /* can be shut without having been closed (e.g. network error) */
       wsptr->WebSocketShut = wsptr->WebSocketClosed = 1;
+      WsLib__WatchDogArm (wsptr);
    }
 
    /* if outstanding I/O */
@@ -1389,7 +1815,6 @@ int OpCode
 )
 {
    int  cnt, hcnt, status;
-   char  *aptr;
    struct WsLibFrmStruct  *frmptr;
 
    /*********/
@@ -1409,12 +1834,8 @@ int OpCode
 
    if (DataCount > 125) DataCount = 125;
 
-   /* allocate a pointer plus a structure (freed by WsLib__OutputFreeAst()) */ 
-   aptr = calloc (1, sizeof(struct WsLibStruct*) +
-                     sizeof(struct WsLibFrmStruct));
-   if (!aptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-   *(struct WsLibStruct**)aptr = wsptr;
-   frmptr = (struct WsLibFrmStruct*)(aptr + sizeof(struct WsLibStruct*));
+   /* pooled message structure (released by WsLib__MsgFreeAst()) */ 
+   frmptr = &WsLib__MsgGet(wsptr)->FrameData;
 
    hcnt = 0;
    frmptr->FrameHeader[hcnt++] = WSLIB_BIT_FIN | OpCode;
@@ -1426,20 +1847,19 @@ int OpCode
       frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[1];
       frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[2];
       frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[3];
-      for (cnt = 0; cnt < DataCount; cnt++)
-         frmptr->FrameHeader[hcnt+cnt] = DataPtr[cnt] ^
-                                 frmptr->MaskingKey[frmptr->MaskCount++&0x3];
+      WsLib__Mask (frmptr->FrameHeader+hcnt, (unsigned char*)DataPtr,
+                   DataCount, frmptr->MaskingKey, &frmptr->MaskCount);
    }
    else
    {
       frmptr->FrameHeader[hcnt++] = DataCount;
-      for (cnt = 0; cnt < DataCount; cnt++)
-         frmptr->FrameHeader[hcnt+cnt] = DataPtr[cnt];
+      memcpy (frmptr->FrameHeader+hcnt, DataPtr, DataCount);
    }
+   cnt = DataCount;
 
    status = sys$qio (WsLibEfnNoWait, wsptr->OutputChannel,
                      IO$_WRITELBLK | IO$M_READERCHECK,
-                     0, WsLib__OutputFreeAst, aptr,
+                     0, WsLib__MsgFreeAst, frmptr,
                      frmptr->FrameHeader, hcnt+cnt, 0, 0, 0, 0);
    if (VMSok(status)) wsptr->QueuedOutput++;
 
@@ -1456,8 +1876,7 @@ static void WsLib__Pong (struct WsLibFrmStruct *frmptr)
 {
    int  cnt, hcnt, status,
         DataCount;
-   char  *aptr,
-         *DataPtr;
+   char  *DataPtr;
    struct WsLibStruct  *wsptr;
 
    /*********/
@@ -1478,12 +1897,8 @@ static void WsLib__Pong (struct WsLibFrmStruct *frmptr)
    DataPtr = frmptr->DataPtr;
    if ((DataCount = frmptr->DataCount) > 125) DataCount = 125;
 
-   /* allocate a pointer plus a structure (freed by WsLib__OutputFreeAst()) */ 
-   aptr = calloc (1, sizeof(struct WsLibStruct*) +
-                     sizeof(struct WsLibFrmStruct));
-   if (!aptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-   *(struct WsLibStruct**)aptr = wsptr;
-   frmptr = (struct WsLibFrmStruct*)(aptr + sizeof(struct WsLibStruct*));
+   /* pooled message structure (released by WsLib__MsgFreeAst()) */ 
+   frmptr = &WsLib__MsgGet(wsptr)->FrameData;
 
    hcnt = 0;
    frmptr->FrameHeader[hcnt++] = WSLIB_BIT_FIN | WSLIB_OPCODE_PONG;
@@ -1495,20 +1910,19 @@ static void WsLib__Pong (struct WsLibFrmStruct *frmptr)
       frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[1];
       frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[2];
       frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[3];
-      for (cnt = 0; cnt < DataCount; cnt++)
-         frmptr->FrameHeader[hcnt+cnt] = DataPtr[cnt] ^
-                                 frmptr->MaskingKey[frmptr->MaskCount++&0x3];
+      WsLib__Mask (frmptr->FrameHeader+hcnt, (unsigned char*)DataPtr,
+                   DataCount, frmptr->MaskingKey, &frmptr->MaskCount);
    }
    else
    {
       frmptr->FrameHeader[hcnt++] = DataCount;
-      for (cnt = 0; cnt < DataCount; cnt++)
-         frmptr->FrameHeader[hcnt+cnt] = DataPtr[cnt];
+      memcpy (frmptr->FrameHeader+hcnt, DataPtr, DataCount);
    }
+   cnt = DataCount;
 
    status = sys$qio (WsLibEfnNoWait, wsptr->OutputChannel,
                      IO$_WRITELBLK | IO$M_READERCHECK,
-                     0, WsLib__OutputFreeAst, aptr,
+                     0, WsLib__MsgFreeAst, frmptr,
                      frmptr->FrameHeader, hcnt+cnt, 0, 0, 0, 0);
    if (VMSok(status)) wsptr->QueuedOutput++;
 
@@ -1615,9 +2029,7 @@ void *AstFunction
       return (SS$_SHUT);
    }
 
-   msgptr = calloc (1, sizeof(struct WsLibMsgStruct));
-   if (!msgptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-   msgptr->WsLibPtr = wsptr;
+   msgptr = WsLib__MsgGet (wsptr);
 
    if (DataPtr)
       wsptr->InputDataMax = 0;
@@ -1641,42 +2053,375 @@ void *AstFunction
 
 /*****************************************************************************/
 /*
-Read a frame (can be a fragment).
-Read six bytes.  See WsLib__ReadHeader1Ast() for breakdown.
+Read a message from WEBSOCKET_INPUT delivering it as a list of the unmasked
+frame (fragment) data buffers rather than coalescing those into a single
+message buffer.  This avoids copying (and reallocating) potentially large
+messages with each fragment.  'DataMax' can limit the total size of the message
+(if zero there is no limit).  If an AST function is supplied then the read is
+asynchronous, otherwise blocking.  Text is delivered as received (i.e. UTF-8).
+Use WsLibReadIovFlatten() if a single (8 bit ASCII) copy is really required.
 */
 
-static void WsLib__ReadFrame (struct WsLibMsgStruct *msgptr)
-
+int WsLibReadIov
+(
+struct WsLibStruct *wsptr,
+int DataMax,
+void *AstFunction
+)
 {
-   struct WsLibFrmStruct  *frmptr;
-   struct WsLibStruct *wsptr;
+   struct WsLibMsgStruct  *msgptr;
 
    /*********/
    /* begin */
    /*********/
 
-   wsptr = msgptr->WsLibPtr;
+   WATCH_WSLIB (wsptr, FI_LI, "READ iov max:!UL", DataMax);
 
-   WATCH_WSLIB (wsptr, FI_LI, "READ frame");
+   if (wsptr->WebSocketClosed)
+   {
+      WsLib__MsgCallback (wsptr, __LINE__, SS$_SHUT, "can't read; closed");
+      wsptr->InputStatus = SS$_SHUT;
+      if (AstFunction) ((void(*)())AstFunction)(wsptr);
+      return (SS$_SHUT);
+   }
 
-   /* reset the frame structure (only needed on subsequent reads) */
-   frmptr = &msgptr->FrameData;
-   if (frmptr->IOsb.iosb$w_status)
-      memset (frmptr, 0, sizeof(struct WsLibFrmStruct));
-   frmptr->WsLibMsgPtr = msgptr;
-   wsptr = frmptr->WsLibMsgPtr->WsLibPtr;
+   msgptr = WsLib__MsgGet (wsptr);
 
-   /* if the client interface is in use then it's TCP/IP */
-   if (wsptr->SocketChannel)
-      /* not really needed on a TCP connection but seems to do no harm! */
-      frmptr->IoRead = IO$_READLBLK | IO$M_WRITERCHECK;
+   msgptr->IovMode = 1;
+   if (DataMax)
+      wsptr->InputDataMax = msgptr->DataMax = DataMax;
    else
-      frmptr->IoRead = IO$_READLBLK | IO$M_STREAM | IO$M_WRITERCHECK;
+      wsptr->InputDataMax = msgptr->DataMax = 4294967295;
+   msgptr->AstFunction = AstFunction;
+   
+   WsLib__ReadFrame (msgptr);
 
-   if (wsptr->RoleClient)
-      frmptr->ReadSize = 2;
-   else
-      frmptr->ReadSize = 6;
+   return (wsptr->InputStatus);
+}
+
+/*****************************************************************************/
+/*
+Read a message from WEBSOCKET_INPUT delivering the unmasked data to the
+'StreamFunction' chunk-by-chunk as it is read.  Only one (mailbox-sized) pooled
+buffer is used per connection irrespective of the message size, allowing (for
+example) large uploads to be written directly to disk.  If an AST function is
+supplied then the read is asynchronous, otherwise blocking.
+*/
+
+int WsLibReadStream
+(
+struct WsLibStruct *wsptr,
+void *StreamFunction,
+void *AstFunction
+)
+{
+   struct WsLibMsgStruct  *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   WATCH_WSLIB (wsptr, FI_LI, "READ stream");
+
+   if (wsptr->WebSocketClosed)
+   {
+      WsLib__MsgCallback (wsptr, __LINE__, SS$_SHUT, "can't read; closed");
+      wsptr->InputStatus = SS$_SHUT;
+      if (AstFunction) ((void(*)())AstFunction)(wsptr);
+      return (SS$_SHUT);
+   }
+
+   msgptr = WsLib__MsgGet (wsptr);
+
+   msgptr->StreamFunction = StreamFunction;
+   msgptr->AstFunction = AstFunction;
+   wsptr->InputDataMax = 0;
+   wsptr->InputStreamCount[0] = wsptr->InputStreamCount[1] = 0;
+   
+   WsLib__ReadFrame (msgptr);
+
+   return (wsptr->InputStatus);
+}
+
+/*****************************************************************************/
+/*
+Return a pointer to a quadword containing the number of bytes delivered to the
+sink function by the most recent WsLibReadStream().
+*/
+
+unsigned long* WsLibReadStreamTotal (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return ((unsigned long*)&wsptr->InputStreamCount);
+}
+
+/*****************************************************************************/
+/*
+Return the number of bytes of a streamed frame still to be read (or 64kB if
+more than that).
+*/
+
+static int WsLib__ReadStreamRemain (struct WsLibFrmStruct *frmptr)
+
+{
+#ifndef __VAX
+   unsigned __int64  remain;
+#endif
+
+   /*********/
+   /* begin */
+   /*********/
+
+#ifdef __VAX
+   return (frmptr->FrameLength[0] - frmptr->StreamCount[0]);
+#else
+   remain = *(unsigned __int64*)frmptr->FrameLength -
+            *(unsigned __int64*)frmptr->StreamCount;
+   if (remain > 65535) return (65535);
+   return ((int)remain);
+#endif
+}
+
+/*****************************************************************************/
+/*
+A chunk of a streamed frame has been read (and unmasked, and if text validated
+and decoded).  Account for it and deliver it to the sink function.  Then reset
+the frame buffer ready for the next chunk.  A compressed chunk is inflated and
+delivered by WsLib__Inflate().  Return false if it could not be.
+*/
+
+static int WsLib__ReadStreamSink (struct WsLibFrmStruct *frmptr)
+
+{
+   int  cnt;
+   struct WsLibStruct  *wsptr;
+   struct WsLibMsgStruct  *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   msgptr = frmptr->WsLibMsgPtr;
+   wsptr = msgptr->WsLibPtr;
+
+#ifdef __VAX
+   {
+      unsigned long q[2] = { frmptr->DataCount, 0 };
+      lib$addx(&q,&frmptr->StreamCount,&frmptr->StreamCount,0);
+      lib$addx(&q,&wsptr->InputCount,&wsptr->InputCount,0);
+   }
+#else
+   *(__int64*)frmptr->StreamCount = *(__int64*)frmptr->StreamCount +
+                                    (__int32)frmptr->DataCount;
+   *(__int64*)wsptr->InputCount = *(__int64*)wsptr->InputCount +
+                                   (__int32)frmptr->DataCount;
+#endif
+
+#ifdef WSLIB_ZLIB
+   if (msgptr->MsgDeflate)
+   {
+      /* inflated data is delivered to the sink as it's produced */
+      if ((cnt = WsLib__Inflate (frmptr)) < 0) return (0);
+   }
+   else
+#endif
+   {
+      if (msgptr->MsgOpcode == WSLIB_OPCODE_TEXT)
+         cnt = frmptr->DecodeCount;
+      else
+         cnt = frmptr->DataCount;
+      if (cnt) (*msgptr->StreamFunction)(wsptr, frmptr->DataPtr, cnt);
+   }
+
+#ifdef __VAX
+   {
+      unsigned long q[2] = { cnt, 0 };
+      lib$addx(&q,&wsptr->InputStreamCount,&wsptr->InputStreamCount,0);
+   }
+#else
+   *(__int64*)wsptr->InputStreamCount = *(__int64*)wsptr->InputStreamCount +
+                                         (__int32)cnt;
+#endif
+
+   msgptr->DataCount += cnt;
+   frmptr->DataCount = frmptr->DecodeCount = 0;
+
+   return (1);
+}
+
+/*****************************************************************************/
+/*
+Return the number of fragment buffers from the most recent WsLibReadIov().
+*/
+
+int WsLibReadIovCount (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return (wsptr->InputIovCount);
+}
+
+/*****************************************************************************/
+/*
+Return a pointer to the (zero-based) indexed fragment buffer or NULL.
+*/
+
+char* WsLibReadIovData
+(
+struct WsLibStruct *wsptr,
+int IovIndex
+)
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (IovIndex < 0 || IovIndex >= wsptr->InputIovCount) return (NULL);
+   return (wsptr->InputIovPtr[IovIndex].DataPtr);
+}
+
+/*****************************************************************************/
+/*
+Return the length of the (zero-based) indexed fragment buffer or zero.
+*/
+
+int WsLibReadIovLength
+(
+struct WsLibStruct *wsptr,
+int IovIndex
+)
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (IovIndex < 0 || IovIndex >= wsptr->InputIovCount) return (0);
+   return (wsptr->InputIovPtr[IovIndex].DataCount);
+}
+
+/*****************************************************************************/
+/*
+Copy the fragment list of the most recent WsLibReadIov() into a single,
+allocated, contiguous, null-terminated buffer.  If WsLibSetAscii() text is
+converted from UTF-8 to 8 bit ASCII.  If 'CountPtr' is supplied it is set to
+the length of the data.  Return a pointer to the buffer, to be WsLibFree()ed
+when no longer required, or NULL if there is an error.
+*/
+
+char* WsLibReadIovFlatten
+(
+struct WsLibStruct *wsptr,
+int *CountPtr
+)
+{
+   int  cnt, idx;
+   char  *cptr, *sptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (CountPtr) *CountPtr = 0;
+
+   /* ensure that even for zero payload some memory is allocated */
+   cptr = sptr = malloc (wsptr->InputDataCount+16);
+   if (!cptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+
+   for (idx = 0; idx < wsptr->InputIovCount; idx++)
+   {
+      memcpy (sptr, wsptr->InputIovPtr[idx].DataPtr,
+                    wsptr->InputIovPtr[idx].DataCount);
+      sptr += wsptr->InputIovPtr[idx].DataCount;
+   }
+   *sptr = '\0';
+   cnt = sptr - cptr;
+
+   if (wsptr->InputOpcode == WSLIB_OPCODE_TEXT && wsptr->SetAscii)
+   {
+      /* convert from UTF-8 to 8 bit "ASCII" */
+      if ((cnt = WsLibFromUtf8 (cptr, cnt, 0)) < 0)
+      {
+         WATCH_WSLIB (wsptr, FI_LI, "UTF-8 decode ERROR");
+         WsLib__MsgCallback (wsptr, __LINE__, SS$_DATALOST,
+                             "UTF-8 decode error");
+         free (cptr);
+         return (NULL);
+      }
+   }
+
+   if (CountPtr) *CountPtr = cnt;
+   return (cptr);
+}
+
+/*****************************************************************************/
+/*
+Free the fragment list (and buffers) of the most recent WsLibReadIov().
+*/
+
+void WsLibReadIovFree (struct WsLibStruct *wsptr)
+
+{
+   int  idx;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!wsptr->InputIovPtr) return;
+
+   for (idx = 0; idx < wsptr->InputIovCount; idx++)
+      WsLib__PoolPut (wsptr, wsptr->InputIovPtr[idx].DataPtr);
+   free (wsptr->InputIovPtr);
+
+   wsptr->InputIovPtr = NULL;
+   wsptr->InputIovCount = 0;
+}
+
+/*****************************************************************************/
+/*
+Read a frame (can be a fragment).
+Read six bytes.  See WsLib__ReadHeader1Ast() for breakdown.
+*/
+
+static void WsLib__ReadFrame (struct WsLibMsgStruct *msgptr)
+
+{
+   struct WsLibFrmStruct  *frmptr;
+   struct WsLibStruct *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr = msgptr->WsLibPtr;
+
+   WATCH_WSLIB (wsptr, FI_LI, "READ frame");
+
+   /* reset the frame structure (only needed on subsequent reads) */
+   frmptr = &msgptr->FrameData;
+   if (frmptr->IOsb.iosb$w_status)
+      memset (frmptr, 0, sizeof(struct WsLibFrmStruct));
+   frmptr->WsLibMsgPtr = msgptr;
+   wsptr = frmptr->WsLibMsgPtr->WsLibPtr;
+
+   /* if the client interface is in use then it's TCP/IP */
+   if (wsptr->SocketChannel)
+      /* not really needed on a TCP connection but seems to do no harm! */
+      frmptr->IoRead = IO$_READLBLK | IO$M_WRITERCHECK;
+   else
+      frmptr->IoRead = IO$_READLBLK | IO$M_STREAM | IO$M_WRITERCHECK;
+
+   if (wsptr->RoleClient)
+      frmptr->ReadSize = 2;
+   else
+      frmptr->ReadSize = 6;
 
    frmptr->IOsb.iosb$w_bcnt = 0;
    frmptr->IOsb.iosb$w_status = SS$_NORMAL;
@@ -1731,7 +2476,6 @@ Perform header sanity checking.
 static void WsLib__ReadHeader1Ast (struct WsLibFrmStruct *frmptr)
 
 {
-   int  status;
    struct WsLibStruct  *wsptr;
    struct WsLibMsgStruct  *msgptr;
 
@@ -1748,6 +2492,8 @@ static void WsLib__ReadHeader1Ast (struct WsLibFrmStruct *frmptr)
       wsptr->WatchDogReadTime = CurrentTime + wsptr->WatchDogReadSecs;
    if (wsptr->WatchDogIdleSecs)
       wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
+   /* a read deadline may be earlier than that armed */
+   WsLib__WatchDogArm (wsptr);
 
    /* loop until the required number of bytes have been read */
    while (VMSok (frmptr->IOsb.iosb$w_status))
@@ -1757,22 +2503,12 @@ static void WsLib__ReadHeader1Ast (struct WsLibFrmStruct *frmptr)
       frmptr->ReadSize -= frmptr->IOsb.iosb$w_bcnt;
       if (!frmptr->ReadSize) break;
 
-      if (msgptr->AstFunction)
-      {
-         /* a loop with an intermediate AST delivery! */
-         status = sys$qio (WsLibEfnNoWait, wsptr->InputChannel, frmptr->IoRead,
-                           &frmptr->IOsb, WsLib__ReadHeader1Ast, frmptr,
-                           frmptr->FrameHeader+frmptr->FrameCount,
-                           frmptr->ReadSize,
-                           0, 0, 0, 0);
-         if (VMSok(status)) wsptr->QueuedInput++;
-         return;
-      }
-
-      sys$qiow (WsLibEfnWait, wsptr->InputChannel, frmptr->IoRead,
-                &frmptr->IOsb, 0, 0,
-                frmptr->FrameHeader+frmptr->FrameCount, frmptr->ReadSize,
-                0, 0, 0, 0);
+      /* a loop with a possible intermediate AST delivery! */
+      if (!WsLib__ReadInput (frmptr,
+                             (char*)frmptr->FrameHeader+frmptr->FrameCount,
+                             frmptr->ReadSize,
+                             msgptr->AstFunction ?
+                                WsLib__ReadHeader1Ast : NULL)) return;
    }
 
    if (VMSnok (frmptr->IOsb.iosb$w_status))
@@ -1818,6 +2554,16 @@ static void WsLib__ReadHeader1Ast (struct WsLibFrmStruct *frmptr)
    frmptr->FrameOpcode = frmptr->FrameHeader[0] & 0x0f;
    frmptr->FramePayload = frmptr->FrameHeader[1] & 0x7f;
 
+   if (frmptr->FrameRsv == WSLIB_BIT_RSV1 &&
+       wsptr->InflateStreamPtr &&
+       (frmptr->FrameOpcode == WSLIB_OPCODE_TEXT ||
+        frmptr->FrameOpcode == WSLIB_OPCODE_BINARY))
+   {
+      /* permessage-deflate, RSV1 on the first frame of a message only */
+      msgptr->MsgDeflate = 1;
+      frmptr->FrameRsv = 0;
+   }
+
    if (frmptr->FrameRsv)
    {
       /* reserve bits set */
@@ -1983,7 +2729,7 @@ For frames less than 126 bytes this function will not be called.
 static void WsLib__ReadHeader2Ast (struct WsLibFrmStruct *frmptr)
 
 {
-   int  cnt, status;
+   int  cnt;
    struct WsLibStruct  *wsptr;
 
    /*********/
@@ -1998,6 +2744,8 @@ static void WsLib__ReadHeader2Ast (struct WsLibFrmStruct *frmptr)
       wsptr->WatchDogReadTime = CurrentTime + wsptr->WatchDogReadSecs;
    if (wsptr->WatchDogIdleSecs)
       wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
+   /* a read deadline may be earlier than that armed */
+   WsLib__WatchDogArm (wsptr);
 
    /* loop until the required number of bytes have been read */
    while (VMSok (frmptr->IOsb.iosb$w_status))
@@ -2007,22 +2755,12 @@ static void WsLib__ReadHeader2Ast (struct WsLibFrmStruct *frmptr)
       frmptr->ReadSize -= frmptr->IOsb.iosb$w_bcnt;
       if (!frmptr->ReadSize) break;
 
-      if (frmptr->WsLibMsgPtr->AstFunction)
-      {
-         /* a loop with an intermediate AST delivery! */
-         status = sys$qio (WsLibEfnNoWait, wsptr->InputChannel, frmptr->IoRead,
-                           &frmptr->IOsb, WsLib__ReadHeader2Ast, frmptr,
-                           frmptr->FrameHeader+frmptr->FrameCount,
-                           frmptr->ReadSize,
-                           0, 0, 0, 0);
-         if (VMSok(status)) wsptr->QueuedInput++;
-         return;
-      }
-
-      sys$qiow (WsLibEfnWait, wsptr->InputChannel, frmptr->IoRead,
-                &frmptr->IOsb, 0, 0,
-                frmptr->FrameHeader+frmptr->FrameCount, frmptr->ReadSize,
-                0, 0, 0, 0);
+      /* a loop with a possible intermediate AST delivery! */
+      if (!WsLib__ReadInput (frmptr,
+                             (char*)frmptr->FrameHeader+frmptr->FrameCount,
+                             frmptr->ReadSize,
+                             frmptr->WsLibMsgPtr->AstFunction ?
+                                WsLib__ReadHeader2Ast : NULL)) return;
    }
 
    if (VMSnok (frmptr->IOsb.iosb$w_status))
@@ -2052,6 +2790,22 @@ static void WsLib__ReadHeader2Ast (struct WsLibFrmStruct *frmptr)
       /* protocol octaword integer in network byte order */
       if (frmptr->FrameHeader[2] || frmptr->FrameHeader[3] ||
           frmptr->FrameHeader[4] || frmptr->FrameHeader[5])
+#ifndef __VAX
+      if (frmptr->WsLibMsgPtr->StreamFunction &&
+          !(frmptr->FrameOpcode & 0x8))
+      {
+         /* streamed data is not held in memory so it can be >2^32 */
+         frmptr->FrameLength[1] = (frmptr->FrameHeader[2] << 24) +
+                                  (frmptr->FrameHeader[3] << 16) +
+                                  (frmptr->FrameHeader[4] << 8) +
+                                   frmptr->FrameHeader[5];
+         frmptr->FrameLength[0] = (frmptr->FrameHeader[6] << 24) +
+                                  (frmptr->FrameHeader[7] << 16) +
+                                  (frmptr->FrameHeader[8] << 8) +
+                                   frmptr->FrameHeader[9];
+      }
+      else
+#endif
       {
          /* if >2^32 then something's probably wrong */
          WsLib__MsgCallback (wsptr, __LINE__, SS$_BUGCHECK,
@@ -2063,10 +2817,13 @@ static void WsLib__ReadHeader2Ast (struct WsLibFrmStruct *frmptr)
          return;
       }
       /* quadword integer in network byte order (lowest 32 bits anyway) */
-      frmptr->FramePayload = (frmptr->FrameHeader[6] << 24) +
-                             (frmptr->FrameHeader[7] << 16) +
-                             (frmptr->FrameHeader[8] << 8) +
-                              frmptr->FrameHeader[9];
+      if (frmptr->FrameLength[1])
+         frmptr->FramePayload = 2147483647;
+      else
+         frmptr->FramePayload = (frmptr->FrameHeader[6] << 24) +
+                                (frmptr->FrameHeader[7] << 16) +
+                                (frmptr->FrameHeader[8] << 8) +
+                                 frmptr->FrameHeader[9];
       if (frmptr->FrameCount == 14)
       {
          /* essentially a longword integer in network byte order */
@@ -2098,8 +2855,7 @@ business logic.
 static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
 
 {
-   int  cnt, status,
-        DataCount,
+   int  DataCount,
         DataSize;
    char  *DataPtr;
    struct WsLibStruct  *wsptr;
@@ -2118,6 +2874,8 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
       wsptr->WatchDogReadTime = CurrentTime + wsptr->WatchDogReadSecs;
    if (wsptr->WatchDogIdleSecs)
       wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
+   /* a read deadline may be earlier than that armed */
+   WsLib__WatchDogArm (wsptr);
 
    while (VMSok (frmptr->IOsb.iosb$w_status))
    {
@@ -2133,30 +2891,44 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
                       frmptr->FrameFinBit ? 1 : 0,
                       frmptr->FrameMaskBit ? 1 : 0);
 
+         /* frame length (only more than 32 bits if streamed) */
+         if (!frmptr->FrameLength[1])
+            frmptr->FrameLength[0] = frmptr->FramePayload;
+
          /* establish buffer */
-         if (frmptr->FramePayload <= 125)
+         if (msgptr->StreamFunction && !(frmptr->FrameOpcode & 0x8))
          {
-            /* use internal frame buffer */
-            frmptr->DataPtr = (char*)frmptr->FrameHeader + frmptr->FrameCount;
+            /* streamed data is read and delivered in buffer-sized chunks */
+            if ((frmptr->DataSize = wsptr->InputMrs) > 65535)
+               frmptr->DataSize = 65535;
+            frmptr->DataPtr = WsLib__PoolGet (wsptr, frmptr->DataSize);
+         }
+         else
+         if (frmptr->FramePayload <= 125 &&
+             (!msgptr->IovMode || (frmptr->FrameOpcode & 0x8)))
+         {
+            /* use internal frame buffer */
+            frmptr->DataPtr = (char*)frmptr->FrameHeader + frmptr->FrameCount;
             frmptr->DataSize = 125;
          }
          else
          {
-            /* allocated frame data buffer */
+            /* allocated frame data buffer (always if fragment list) */
             frmptr->DataSize = frmptr->FramePayload;
             /* ensure that even for zero payload some memory is allocated */
-            frmptr->DataPtr = calloc (1, frmptr->DataSize+16);
-            if (!frmptr->DataPtr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+            frmptr->DataPtr = WsLib__PoolGet (wsptr, frmptr->DataSize+16);
          }
       }
 
       if (frmptr->IOsb.iosb$w_bcnt)
       {
          DataPtr = frmptr->DataPtr + frmptr->DataCount;
-         if (msgptr->MsgOpcode == WSLIB_OPCODE_TEXT)
+         if (msgptr->MsgOpcode == WSLIB_OPCODE_TEXT &&
+             !msgptr->MsgDeflate &&
+             !(frmptr->FrameOpcode & 0x8))
          {
-            /* will also apply masking key if required */
-            if (!WsLib__Utf8Legal (frmptr))
+            /* unmask, validate and (if required) decode in the one pass */
+            if (!WsLib__Utf8Decode (frmptr))
             {
                WATCH_WSLIB (wsptr, FI_LI, "UTF-8 illegal (fast fail)");
                frmptr->IOsb.iosb$w_status = SS$_BADESCAPE;
@@ -2169,42 +2941,55 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
          if (frmptr->FrameMaskBit)
          {
             /* apply masking key */
-            for (cnt = 0; cnt < frmptr->IOsb.iosb$w_bcnt; cnt++)
-               DataPtr[cnt] ^= frmptr->MaskingKey[frmptr->MaskCount++&0x3];
+            WsLib__Mask ((unsigned char*)DataPtr, (unsigned char*)DataPtr,
+                         frmptr->IOsb.iosb$w_bcnt,
+                         frmptr->MaskingKey, &frmptr->MaskCount);
          }
          frmptr->DataCount += frmptr->IOsb.iosb$w_bcnt;
+
+         if (msgptr->StreamFunction && !(frmptr->FrameOpcode & 0x8))
+         {
+            /* deliver any (inflate) error status to the application */
+            if (!WsLib__ReadStreamSink (frmptr)) break;
+         }
       }
 
-      WATCH_WSLIB (wsptr, FI_LI, "READ inque:!UL payload:!UL/!UL !AZ",
-                   wsptr->QueuedInput,
-                   frmptr->DataCount, frmptr->FramePayload,
-                   frmptr->DataCount >= frmptr->FramePayload ?
-                      "COMPLETE" : "in-progress");
+      if (msgptr->StreamFunction && !(frmptr->FrameOpcode & 0x8))
+      {
+         /* streamed data is always read into the start of the buffer */
+         WATCH_WSLIB (wsptr, FI_LI, "READ inque:!UL stream:!UQ/!UQ",
+                      wsptr->QueuedInput,
+                      &frmptr->StreamCount, &frmptr->FrameLength);
 
-      if (frmptr->DataCount >= frmptr->FramePayload) break;
+         if (!(DataCount = WsLib__ReadStreamRemain (frmptr))) break;
 
-      DataPtr = frmptr->DataPtr + frmptr->DataCount;
-      if (frmptr->FramePayload - frmptr->DataCount <= wsptr->InputMrs)
-         DataCount = frmptr->FramePayload - frmptr->DataCount;
+         DataPtr = frmptr->DataPtr;
+         if (DataCount > wsptr->InputMrs) DataCount = wsptr->InputMrs;
+         if (DataCount > frmptr->DataSize) DataCount = frmptr->DataSize;
+      }
       else
-         DataCount = wsptr->InputMrs;
-      if (frmptr->DataCount + DataCount > frmptr->DataSize)
-         DataCount = frmptr->DataSize - frmptr->DataCount;
-
-      if (msgptr->AstFunction)
       {
-         /* asynchronous read */
-         status = sys$qio (WsLibEfnNoWait, wsptr->InputChannel, frmptr->IoRead,
-                           &frmptr->IOsb, WsLib__ReadDataAst, frmptr,
-                           DataPtr, DataCount, 0, 0, 0, 0);
-         if (VMSok(status)) wsptr->QueuedInput++;
-         return;
+         WATCH_WSLIB (wsptr, FI_LI, "READ inque:!UL payload:!UL/!UL !AZ",
+                      wsptr->QueuedInput,
+                      frmptr->DataCount, frmptr->FramePayload,
+                      frmptr->DataCount >= frmptr->FramePayload ?
+                         "COMPLETE" : "in-progress");
+
+         if (frmptr->DataCount >= frmptr->FramePayload) break;
+
+         DataPtr = frmptr->DataPtr + frmptr->DataCount;
+         if (frmptr->FramePayload - frmptr->DataCount <= wsptr->InputMrs)
+            DataCount = frmptr->FramePayload - frmptr->DataCount;
+         else
+            DataCount = wsptr->InputMrs;
+         if (frmptr->DataCount + DataCount > frmptr->DataSize)
+            DataCount = frmptr->DataSize - frmptr->DataCount;
       }
 
-      /* synchronous read */
-      sys$qiow (WsLibEfnWait, wsptr->InputChannel, frmptr->IoRead,
-                &frmptr->IOsb, 0, 0,
-                DataPtr, DataCount, 0, 0, 0, 0);
+      /* asynchronous or synchronous read (or from buffered input) */
+      if (!WsLib__ReadInput (frmptr, DataPtr, DataCount,
+                             msgptr->AstFunction ?
+                                WsLib__ReadDataAst : NULL)) return;
    }
 
    WATCH_WSLIB (wsptr, FI_LI, "READ %X!8XL", frmptr->IOsb.iosb$w_status);
@@ -2251,6 +3036,15 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
          frmptr->IOsb.iosb$w_status = SS$_SHUT;
          /* deliver closed status to the application */
       }
+#ifdef WSLIB_ZLIB
+      else
+      if (msgptr->MsgDeflate && !msgptr->StreamFunction)
+      {
+         /* replace the compressed frame data with the inflated */
+         WsLib__Inflate (frmptr);
+         /* any error status is delivered to the application */
+      }
+#endif
    }
 
    /*****************/
@@ -2272,7 +3066,18 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
                                       (__int32)frmptr->DataCount;
 #endif
 
+      /* text may have been decoded in-situ to fewer 8 bit ASCII bytes */
+      if (msgptr->MsgOpcode == WSLIB_OPCODE_TEXT)
+         frmptr->DataCount = frmptr->DecodeCount;
+
       if (!(DataSize = msgptr->DataMax)) DataSize = msgptr->DataSize;
+      if (msgptr->StreamFunction)
+      {
+         /* already delivered to the sink, just release the buffer */
+         WsLib__PoolPut (wsptr, frmptr->DataPtr);
+         frmptr->DataPtr = NULL;
+      }
+      else
       if (msgptr->DataCount + frmptr->DataCount > (unsigned)DataSize)
       {
          WsLib__MsgCallback (wsptr, __LINE__, SS$_RESULTOVF,
@@ -2282,6 +3087,25 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
          msgptr->DataCount = 0;
       }
       else
+      if (msgptr->IovMode)
+      {
+         /* fragment list, just take over the frame data buffer */
+         if (frmptr->DataCount)
+         {
+            if (msgptr->IovCount >= msgptr->IovSize)
+            {
+               msgptr->IovSize += 8;
+               msgptr->IovPtr = realloc (msgptr->IovPtr, msgptr->IovSize *
+                                         sizeof(struct WsLibIovStruct));
+               if (!msgptr->IovPtr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+            }
+            msgptr->IovPtr[msgptr->IovCount].DataPtr = frmptr->DataPtr;
+            msgptr->IovPtr[msgptr->IovCount++].DataCount = frmptr->DataCount;
+            msgptr->DataCount += frmptr->DataCount;
+            frmptr->DataPtr = NULL;
+         }
+      }
+      else
       if (msgptr->DataMax)
       {
          /* dynamic buffer */
@@ -2318,8 +3142,9 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
          msgptr->DataCount += frmptr->DataCount;
       }
 
-      /* dispose any allocated frame data buffer */
-      if (frmptr->FramePayload > 125) free (frmptr->DataPtr);
+      /* dispose any allocated (or inflated) frame data buffer */
+      if (frmptr->FramePayload > 125 || msgptr->IovMode || msgptr->MsgDeflate)
+         if (frmptr->DataPtr) WsLib__PoolPut (wsptr, frmptr->DataPtr);
 
       if (VMSok (msgptr->MsgStatus))
       {
@@ -2332,6 +3157,13 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
          }
       }
    }
+   else
+   if ((msgptr->IovMode || msgptr->StreamFunction) &&
+       !(frmptr->FrameOpcode & 0x8))
+   {
+      /* dispose any allocated fragment list or stream data buffer */
+      if (frmptr->DataPtr) WsLib__PoolPut (wsptr, frmptr->DataPtr);
+   }
 
    if (VMSok (msgptr->MsgStatus))
    {
@@ -2339,7 +3171,7 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
       {
          /* ensure any code-point is complete */
          frmptr->IOsb.iosb$w_bcnt = 0;
-         if (!WsLib__Utf8Legal (frmptr))
+         if (!WsLib__Utf8Decode (frmptr))
          {
             WATCH_WSLIB (wsptr, FI_LI, "UTF-8 illegal (fast fail)");
             msgptr->MsgStatus = SS$_BADESCAPE;
@@ -2362,8 +3194,11 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
       *(__int64*)wsptr->InputMsgCount = *(__int64*)wsptr->InputMsgCount + 1;
 #endif
 
-      if (msgptr->MsgOpcode == WSLIB_OPCODE_TEXT)
+      if (msgptr->MsgOpcode == WSLIB_OPCODE_TEXT &&
+          !msgptr->IovMode && !msgptr->StreamFunction)
       {
+         /* any UTF-8 to 8 bit "ASCII" was decoded as the frames were read */
+
          /* for text always better if it's null-terminated */
          if (msgptr->DataMax ||
              msgptr->DataCount < msgptr->DataSize)
@@ -2371,24 +3206,19 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
          else
             WsLib__MsgCallback (wsptr, __LINE__, SS$_BUFFEROVF,
                                 "no space for \\0");
+      }
+   }
 
-         if (wsptr->SetAscii)
-         {
-            /* convert from UTF-8 to 8 bit "ASCII" */
-            WATCH_WSLIB (wsptr, FI_LI, "UTF-8 decode");
-            cnt = WsLibFromUtf8 (msgptr->DataPtr, msgptr->DataCount, 0);
-            if (cnt >= 0)
-               msgptr->DataCount = cnt;
-            else
-            {
-               /* error in UTF-8 to ASCII conversion */
-               WATCH_WSLIB (wsptr, FI_LI, "UTF-8 decode ERROR");
-               WsLib__MsgCallback (wsptr, __LINE__, SS$_DATALOST,
-                                   "UTF-8 decode error");
-               msgptr->MsgStatus = SS$_DATALOST;
-               msgptr->DataCount = 0;
-            }
-         }
+   if (msgptr->IovMode)
+   {
+      /* release any previous list and then make this one current */
+      if (wsptr->InputIovPtr) WsLibReadIovFree (wsptr);
+      wsptr->InputIovPtr = msgptr->IovPtr;
+      wsptr->InputIovCount = msgptr->IovCount;
+      if (VMSnok (msgptr->MsgStatus))
+      {
+         WsLibReadIovFree (wsptr);
+         msgptr->DataCount = 0;
       }
    }
 
@@ -2429,6 +3259,7 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
    if (msgptr->AstFunction)
    {
       msgptr->AstFunction (wsptr);
+      if (msgptr->IovMode) WsLibReadIovFree (wsptr);
       if (!DataPtr && msgptr->DataMax)
       {
          /* if the dynamic message buffer has not been grabbed then free it */
@@ -2442,7 +3273,7 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
       }
    }
 
-   free (msgptr);
+   WsLib__MsgPut (msgptr);
 
    wsptr->WatchDogReadTime = 0;
    if (wsptr->WatchDogIdleSecs)
@@ -2453,6 +3284,154 @@ static void WsLib__ReadDataAst (struct WsLibFrmStruct *frmptr)
    if (wsptr->WebSocketShut) WsLib__Shut (wsptr); 
 }
 
+/*****************************************************************************/
+/*
+Supply up to 'DataCount' bytes of WebSocket input to 'DataPtr' for the frame
+currently being read.  Input is buffered, with each $QIO reading up to the
+WEBSOCKET_INPUT_MRS (or socket) size, so that a mailbox (stream) read containing
+multiple small frames (e.g. keystrokes) has each header, extended length and
+payload parsed from that buffer rather than each requiring its own $QIO.  When
+the buffer is empty and the request is at least the size of the buffer (large
+payloads) the data is read directly into the frame buffer avoiding the copy.
+Returns true if the frame IOsb has been populated (from buffered input or by a
+synchronous read) and the caller should continue, false if an asynchronous read
+has been queued and the caller should just return (awaiting AST delivery).
+*/
+
+static int WsLib__ReadInput
+(
+struct WsLibFrmStruct *frmptr,
+char *DataPtr,
+int DataCount,
+void *AstFunction
+)
+{
+   int  cnt, status;
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr = frmptr->WsLibMsgPtr->WsLibPtr;
+
+   if (wsptr->InputBufCount)
+   {
+      /* (at least partially) satisfy from buffered input */
+      if ((cnt = DataCount) > wsptr->InputBufCount) cnt = wsptr->InputBufCount;
+      memcpy (DataPtr, wsptr->InputBufCurPtr, cnt);
+      wsptr->InputBufCurPtr += cnt;
+      wsptr->InputBufCount -= cnt;
+      frmptr->IOsb.iosb$w_bcnt = cnt;
+      frmptr->IOsb.iosb$w_status = SS$_NORMAL;
+      return (1);
+   }
+
+   if (!wsptr->InputBufSize)
+   {
+      /* first read, allocate the input buffer */
+      if ((wsptr->InputBufSize = wsptr->InputMrs) > 65535 ||
+          !wsptr->InputBufSize)
+         wsptr->InputBufSize = 65535;
+      wsptr->InputBufPtr = malloc (wsptr->InputBufSize);
+      if (!wsptr->InputBufPtr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+   }
+
+   /* accumulate the number of input $QIOs */
+#ifdef __VAX
+   {
+      unsigned long q[2] = { 1, 0 };
+      lib$addx(&q,&wsptr->InputIoCount,&wsptr->InputIoCount,0);
+   }
+#else
+   *(__int64*)wsptr->InputIoCount = *(__int64*)wsptr->InputIoCount + 1;
+#endif
+
+   if (DataCount >= wsptr->InputBufSize)
+   {
+      /* large payload, read directly into the frame buffer */
+      if (AstFunction)
+      {
+         status = sys$qio (WsLibEfnNoWait, wsptr->InputChannel, frmptr->IoRead,
+                           &frmptr->IOsb, AstFunction, frmptr,
+                           DataPtr, DataCount, 0, 0, 0, 0);
+         if (VMSok(status)) wsptr->QueuedInput++;
+         return (0);
+      }
+
+      sys$qiow (WsLibEfnWait, wsptr->InputChannel, frmptr->IoRead,
+                &frmptr->IOsb, 0, 0,
+                DataPtr, DataCount, 0, 0, 0, 0);
+      return (1);
+   }
+
+   /* read into the input buffer */
+   frmptr->BufDataPtr = DataPtr;
+   frmptr->BufDataCount = DataCount;
+   frmptr->BufAstFunction = AstFunction;
+
+   if (AstFunction)
+   {
+      status = sys$qio (WsLibEfnNoWait, wsptr->InputChannel, frmptr->IoRead,
+                        &wsptr->InputBufIOsb, WsLib__ReadBufferAst, frmptr,
+                        wsptr->InputBufPtr, wsptr->InputBufSize, 0, 0, 0, 0);
+      if (VMSok(status)) wsptr->QueuedInput++;
+      return (0);
+   }
+
+   sys$qiow (WsLibEfnWait, wsptr->InputChannel, frmptr->IoRead,
+             &wsptr->InputBufIOsb, 0, 0,
+             wsptr->InputBufPtr, wsptr->InputBufSize, 0, 0, 0, 0);
+   WsLib__ReadBufferAst (frmptr);
+   return (1);
+}
+
+/*****************************************************************************/
+/*
+The input buffer $QIOed by WsLib__ReadInput() has been read.  Populate the
+frame's IOsb and data from the buffer (or with the error status) and then
+(if asynchronous) pass on to the frame's actual read AST.  That AST accounts
+for the queued I/O.
+*/
+
+static void WsLib__ReadBufferAst (struct WsLibFrmStruct *frmptr)
+
+{
+   int  cnt;
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr = frmptr->WsLibMsgPtr->WsLibPtr;
+
+   WATCH_WSLIB (wsptr, FI_LI, "READ buffer %X!8XL !UL",
+                wsptr->InputBufIOsb.iosb$w_status,
+                wsptr->InputBufIOsb.iosb$w_bcnt);
+
+   if (VMSok (wsptr->InputBufIOsb.iosb$w_status))
+   {
+      wsptr->InputBufCurPtr = wsptr->InputBufPtr;
+      wsptr->InputBufCount = wsptr->InputBufIOsb.iosb$w_bcnt;
+      if ((cnt = frmptr->BufDataCount) > wsptr->InputBufCount)
+         cnt = wsptr->InputBufCount;
+      memcpy (frmptr->BufDataPtr, wsptr->InputBufCurPtr, cnt);
+      wsptr->InputBufCurPtr += cnt;
+      wsptr->InputBufCount -= cnt;
+      frmptr->IOsb.iosb$w_bcnt = cnt;
+      frmptr->IOsb.iosb$w_status = SS$_NORMAL;
+   }
+   else
+   {
+      wsptr->InputBufCount = 0;
+      frmptr->IOsb.iosb$w_bcnt = 0;
+      frmptr->IOsb.iosb$w_status = wsptr->InputBufIOsb.iosb$w_status;
+   }
+
+   if (frmptr->BufAstFunction) (*frmptr->BufAstFunction)(frmptr);
+}
+
 /*****************************************************************************/
 /*
 When using dynamic message data buffer grab the allocated memory returning a
@@ -2593,6 +3572,22 @@ unsigned long* WsLibReadTotal (struct WsLibStruct *wsptr)
    return ((unsigned long*)&wsptr->InputCount);
 }
 
+/*****************************************************************************/
+/*
+Return a pointer to the total read $QIOs value (quadword).  Compared to the
+total messages read this indicates the effectiveness of input buffering.
+*/
+
+unsigned long* WsLibReadIoTotal (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return ((unsigned long*)&wsptr->InputIoCount);
+}
+
 /*****************************************************************************/
 /*
 Return a pointer to the total messages read value (quadword).
@@ -2610,30 +3605,155 @@ unsigned long* WsLibReadMsgTotal (struct WsLibStruct *wsptr)
 
 /*****************************************************************************/
 /*
-Generate a masking key for the supplied IO structure.
+Generate a masking key for the supplied IO structure.  RFC 6455 requires keys
+be unpredictable so they are taken from a xoshiro128** generator, seeded once
+(via splitmix32) from the system time and process ID, and generated a block of
+WSLIB_MASK_KEYS at a time so the per-frame cost is an array fetch.  32 bit
+arithmetic only so that it is the same on VAX, Alpha and Itanium.
 */
 
 static void WsLib__MaskingKey (struct WsLibFrmStruct *frmptr)
 
 {
-   static unsigned long  RandomNumber,
-                         RandomFiller;
+#define WSLIB_ROTL(x,k) (((x) << (k)) | ((x) >> (32 - (k))))
+
+   static int  KeyCount;
+   static unsigned int  KeyBlock [WSLIB_MASK_KEYS],
+                        KeyState [4];
+
+   int  idx;
+   unsigned int  key, tmp;
+   unsigned long  BinTime [2];
 
    /*********/
    /* begin */
    /*********/
 
-   /* pseudo-random 32 bytes */
-   if (!(RandomNumber & 0xff)) sys$gettim (&RandomNumber);
-   RandomNumber = RandomNumber * 69069 + 1;
+   if (!KeyCount)
+   {
+      if (!(KeyState[0] | KeyState[1] | KeyState[2] | KeyState[3]))
+      {
+         /* seed (splitmix32) */
+         sys$gettim (&BinTime);
+         key = BinTime[0] ^ BinTime[1] ^ ((unsigned int)getpid() << 16);
+         for (idx = 0; idx < 4; idx++)
+         {
+            tmp = (key += 0x9e3779b9);
+            tmp = (tmp ^ (tmp >> 16)) * 0x85ebca6b;
+            tmp = (tmp ^ (tmp >> 13)) * 0xc2b2ae35;
+            KeyState[idx] = tmp ^ (tmp >> 16);
+         }
+         /* an all-zero state would be a fixed point */
+         if (!(KeyState[0] | KeyState[1] | KeyState[2] | KeyState[3]))
+            KeyState[0] = 0x9e3779b9;
+      }
+
+      /* xoshiro128** */
+      for (idx = 0; idx < WSLIB_MASK_KEYS; idx++)
+      {
+         tmp = KeyState[1] * 5;
+         KeyBlock[idx] = WSLIB_ROTL(tmp,7) * 9;
+         tmp = KeyState[1] << 9;
+         KeyState[2] ^= KeyState[0];
+         KeyState[3] ^= KeyState[1];
+         KeyState[1] ^= KeyState[2];
+         KeyState[0] ^= KeyState[3];
+         KeyState[2] ^= tmp;
+         KeyState[3] = WSLIB_ROTL(KeyState[3],11);
+      }
+      KeyCount = WSLIB_MASK_KEYS;
+   }
+
+   key = KeyBlock[--KeyCount];
 
    frmptr->MaskCount = 0;
    frmptr->FrameMaskBit = 0x80;
    /* network byte order */
-   frmptr->MaskingKey[0] = (RandomNumber & 0xff000000) >> 24;
-   frmptr->MaskingKey[1] = (RandomNumber & 0x00ff0000) >> 16;
-   frmptr->MaskingKey[2] = (RandomNumber & 0x0000ff00) >> 8;
-   frmptr->MaskingKey[3] = RandomNumber & 0x000000ff;
+   frmptr->MaskingKey[0] = (key & 0xff000000) >> 24;
+   frmptr->MaskingKey[1] = (key & 0x00ff0000) >> 16;
+   frmptr->MaskingKey[2] = (key & 0x0000ff00) >> 8;
+   frmptr->MaskingKey[3] = key & 0x000000ff;
+
+#undef WSLIB_ROTL
+}
+
+/*****************************************************************************/
+/*
+Apply the masking key to 'DataCount' bytes from 'SrcPtr' to 'DstPtr' (which
+may be the same buffer for in-situ masking).  '*MaskCountPtr' is the running
+byte offset into the key and is updated so that masking can be continued
+across multiple reads.  Leading bytes are masked until the destination is
+aligned, the bulk is then XORed a machine word at a time (quadword, longword on
+VAX) four words per step, followed by any trailing bytes.  Unaligned source
+data (copy masking) is accessed using __unaligned.
+*/
+
+static void WsLib__Mask
+(
+unsigned char *DstPtr,
+unsigned char *SrcPtr,
+int DataCount,
+unsigned char *MaskingKey,
+int *MaskCountPtr
+)
+{
+   int  idx, mcnt;
+   unsigned char  *dptr, *sptr;
+   unsigned char  KeyBytes [sizeof(WSLIB_MASK_WORD)];
+   WSLIB_MASK_WORD  KeyWord;
+   WSLIB_MASK_WORD  *dwptr;
+   __unaligned WSLIB_MASK_WORD  *swptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   dptr = DstPtr;
+   sptr = SrcPtr;
+   mcnt = *MaskCountPtr;
+
+   /* leading bytes until the destination is word aligned */
+   while (DataCount &&
+          ((unsigned long)dptr & (sizeof(WSLIB_MASK_WORD)-1)))
+   {
+      *dptr++ = *sptr++ ^ MaskingKey[mcnt++&0x3];
+      DataCount--;
+   }
+
+   if (DataCount >= sizeof(WSLIB_MASK_WORD))
+   {
+      /* key rotated to the current offset and replicated across the word,
+         the word size is a multiple of the key size so this is constant */
+      for (idx = 0; idx < sizeof(WSLIB_MASK_WORD); idx++)
+         KeyBytes[idx] = MaskingKey[(mcnt+idx)&0x3];
+      memcpy (&KeyWord, KeyBytes, sizeof(KeyWord));
+
+      dwptr = (WSLIB_MASK_WORD*)dptr;
+      swptr = (__unaligned WSLIB_MASK_WORD*)sptr;
+      mcnt += DataCount & ~(sizeof(WSLIB_MASK_WORD)-1);
+      while (DataCount >= sizeof(WSLIB_MASK_WORD) * 4)
+      {
+         dwptr[0] = swptr[0] ^ KeyWord;
+         dwptr[1] = swptr[1] ^ KeyWord;
+         dwptr[2] = swptr[2] ^ KeyWord;
+         dwptr[3] = swptr[3] ^ KeyWord;
+         dwptr += 4;
+         swptr += 4;
+         DataCount -= sizeof(WSLIB_MASK_WORD) * 4;
+      }
+      while (DataCount >= sizeof(WSLIB_MASK_WORD))
+      {
+         *dwptr++ = *swptr++ ^ KeyWord;
+         DataCount -= sizeof(WSLIB_MASK_WORD);
+      }
+      dptr = (unsigned char*)dwptr;
+      sptr = (unsigned char*)swptr;
+   }
+
+   /* trailing bytes */
+   while (DataCount--) *dptr++ = *sptr++ ^ MaskingKey[mcnt++&0x3];
+
+   *MaskCountPtr = mcnt;
 }
 
 /*****************************************************************************/
@@ -2683,11 +3803,12 @@ int DataCount,
 void *AstFunction
 )
 {
-   int  cnt, hcnt, status,
+   int  astatus, cnt, hcnt, status,
+        Headroom,
         Utf8Count;
-   unsigned char  *cptr, *czptr, *sptr;
    struct WsLibFrmStruct  *frmptr;
    struct WsLibMsgStruct  *msgptr;
+   struct WsLibPrepStruct  *prepptr;
 
    /*********/
    /* begin */
@@ -2695,6 +3816,14 @@ void *AstFunction
 
    WATCH_WSLIB (wsptr, FI_LI, "WRITE count:!UL", DataCount);
 
+   /* only ever applies to the one write (see WsLibWriteHeadroom()) */
+   Headroom = wsptr->WriteHeadroom;
+   wsptr->WriteHeadroom = 0;
+
+   /* likewise (see WsLibWritePrepared()) */
+   prepptr = wsptr->WritePrepPtr;
+   wsptr->WritePrepPtr = NULL;
+
    if (wsptr->WebSocketClosed)
    {
       WsLib__MsgCallback (wsptr, __LINE__, SS$_SHUT, "can't write; closed");
@@ -2704,10 +3833,6 @@ void *AstFunction
       return (SS$_SHUT);
    }
 
-   msgptr = calloc (1, sizeof(struct WsLibMsgStruct));
-   if (!msgptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-   msgptr->WsLibPtr = wsptr;
-
    /* null or empty writes send an empty message */
    if (!DataPtr)
    {
@@ -2715,43 +3840,77 @@ void *AstFunction
       DataCount = 0;
    }
 
+   if (AstFunction == WSLIB_ASYNCH &&
+       ((wsptr->OutputByteLimit &&
+         wsptr->OutputQueuedBytes + DataCount > wsptr->OutputByteLimit) ||
+        (wsptr->OutputMsgLimit &&
+         wsptr->OutputQueuedMsgs >= wsptr->OutputMsgLimit)))
+   {
+      /* fire-and-forget output would exceed the high-water mark */
+      WsLib__MsgCallback (wsptr, __LINE__, SS$_EXQUOTA,
+                          "output queue !UL bytes !UL messages",
+                          wsptr->OutputQueuedBytes, wsptr->OutputQueuedMsgs);
+      /* only a queued write's completion can unblock (see WsLib__WriteAst()) */
+      if (wsptr->OutputQueuedMsgs) wsptr->OutputBlocked = 1;
+      return (SS$_EXQUOTA);
+   }
+
+   msgptr = WsLib__MsgGet (wsptr);
+
+   /* queued output accounting (see WsLibSetOutputLimit()) */
+   msgptr->QueuedCount = DataCount;
+   wsptr->OutputQueuedBytes += DataCount;
+   wsptr->OutputQueuedMsgs++;
+   if ((wsptr->OutputByteLimit &&
+        wsptr->OutputQueuedBytes >= wsptr->OutputByteLimit) ||
+       (wsptr->OutputMsgLimit &&
+        wsptr->OutputQueuedMsgs >= wsptr->OutputMsgLimit))
+      wsptr->OutputBlocked = 1;
+
    msgptr->DataPtr = DataPtr;
    msgptr->DataCount = DataCount;
    msgptr->AstFunction = AstFunction;
+   msgptr->Headroom = Headroom;
 
+   if (prepptr)
+   {
+      /* already encoded and framed, hold a reference until written */
+      astatus = sys$setast (0);
+      prepptr->RefCount++;
+      if (astatus == SS$_WASSET) sys$setast (1);
+      msgptr->PrepPtr = prepptr;
+      msgptr->MsgOpcode = prepptr->Opcode;
+   }
+   else
    if (wsptr->SetAscii)
    {
       /* test if any UTF-8 encoding required */
-      Utf8Count = 0;
-      czptr = (cptr = (unsigned char*)DataPtr) + DataCount;
-      while (cptr < czptr) if (*cptr++ & 0x80) Utf8Count++;
-
-      if (Utf8Count)
+      if (Utf8Count = WsLib__Utf8Count (DataPtr, DataCount))
       {
          /********************/
          /* convert to UTF-8 */
          /********************/
 
          WATCH_WSLIB (wsptr, FI_LI, "UTF-8 encode");
-         msgptr->Utf8Ptr = calloc (1, DataCount+Utf8Count); 
-         if (!msgptr->Utf8Ptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-         czptr = (cptr = (unsigned char*)DataPtr) + DataCount;
-         sptr = (unsigned char*)msgptr->Utf8Ptr;
-         while (cptr < czptr)
-         {
-            if (*cptr & 0x80)
-            {
-               *sptr++ = ((*cptr & 0xc0) >> 6) | 0xc0;
-               *sptr++ = (*cptr++ & 0x3f) | 0x80;
-            }
-            else
-               *sptr++ = *cptr++;
-         }
-         msgptr->DataPtr = msgptr->Utf8Ptr;
-         msgptr->DataCount = (char*)sptr - msgptr->Utf8Ptr;
+         /* leave headroom for the frame header (see WsLib__WriteAst()) */
+         msgptr->Utf8Ptr = WsLib__PoolGet (wsptr, WSLIB_HEADROOM +
+                                                  DataCount+Utf8Count); 
+         msgptr->DataPtr = msgptr->Utf8Ptr + WSLIB_HEADROOM;
+         msgptr->DataCount = DataCount + Utf8Count;
+         WsLib__Utf8Encode ((unsigned char*)msgptr->DataPtr,
+                            (unsigned char*)DataPtr, DataCount);
       }
    }
 
+#ifdef WSLIB_ZLIB
+   /* permessage-deflate (if negotiated and worth the effort) */
+   if (!prepptr &&
+       wsptr->DeflateStreamPtr &&
+       wsptr->DeflateLevel &&
+       msgptr->DataCount >= WSLIB_DEFLATE_MIN)
+      WsLib__Deflate (msgptr);
+#endif
+
    frmptr = &msgptr->FrameData;
    frmptr->WsLibMsgPtr = msgptr;
    frmptr->IOsb.iosb$w_status = SS$_NORMAL;
@@ -2765,38 +3924,275 @@ void *AstFunction
 
 /*****************************************************************************/
 /*
-Write the message to the WebSocket.  Message may be automatically fragmented.
-Can AST back to this function one or more times with asycnchronous I/O.
+As for WsLibWrite() but the 'HeadroomCount' bytes immediately preceding the
+data may be overwritten.  This allows the frame header to be placed directly in
+front of the payload and header plus payload written using the one $QIO
+(rather than one for the header and one or more for the data).
 */
 
-static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
+int WsLibWriteHeadroom
+(
+struct WsLibStruct *wsptr,
+char *DataPtr,
+int DataCount,
+int HeadroomCount,
+void *AstFunction
+)
+{
+   int  status;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr->WriteHeadroom = HeadroomCount;
+   status = WsLibWrite (wsptr, DataPtr, DataCount, AstFunction);
+   return (status);
+}
+
+/*****************************************************************************/
+/*
+Encode (to UTF-8 if text) and frame (server role, unmasked, single frame) a
+message the once, so that it can then be written to any number of websockets
+using WsLibWritePrepared() without repeating the work for each.  The header is
+placed immediately in front of the data in the one allocation so the complete
+frame can be written using a single $QIO.  The returned structure carries the
+caller's reference which must be WsLibMsgRelease()ed.
+*/
 
+struct WsLibPrepStruct* WsLibMsgPrepare
+(
+char *DataPtr,
+int DataCount,
+int Opcode
+)
 {
-   int  cnt, count, hcnt, length, status,
-        DataCount;
-   char  *pointer,
-         *DataPtr;
-   struct WsLibStruct  *wsptr;
-   struct WsLibMsgStruct  *msgptr;
+   int  hcnt,
+        Utf8Count;
+   unsigned char  *hptr;
+   struct WsLibPrepStruct  *prepptr;
 
    /*********/
    /* begin */
    /*********/
 
-   msgptr = frmptr->WsLibMsgPtr;
-   wsptr = msgptr->WsLibPtr;
+   if (Opcode != WSLIB_OPCODE_TEXT &&
+       Opcode != WSLIB_OPCODE_BINARY) return (NULL);
 
-   if (wsptr->QueuedOutput) wsptr->QueuedOutput--;
+   if (!DataPtr) DataCount = 0;
 
-   if (wsptr->WatchDogIdleSecs)
-      wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
+   if (Opcode == WSLIB_OPCODE_TEXT)
+      Utf8Count = WsLib__Utf8Count (DataPtr, DataCount);
+   else
+      Utf8Count = 0;
 
-   while (VMSok (frmptr->IOsb.iosb$w_status))
+   /* leave headroom for the frame header */
+   prepptr = calloc (1, sizeof(struct WsLibPrepStruct) +
+                        WSLIB_HEADROOM + DataCount + Utf8Count);
+   if (!prepptr) WsLibExit (NULL, FI_LI, vaxc$errno);
+
+   prepptr->DataPtr = (char*)prepptr + sizeof(struct WsLibPrepStruct) +
+                      WSLIB_HEADROOM;
+   if (Utf8Count)
+      WsLib__Utf8Encode ((unsigned char*)prepptr->DataPtr,
+                         (unsigned char*)DataPtr, DataCount);
+   else
+   if (DataCount)
+      memcpy (prepptr->DataPtr, DataPtr, DataCount);
+   prepptr->DataCount = DataCount += Utf8Count;
+   prepptr->FrameCount = 1;
+   prepptr->Opcode = Opcode;
+   prepptr->RefCount = 1;
+
+   if (DataCount <= 125)
+      hcnt = 2;
+   else
+   if (DataCount <= 65535)
+      hcnt = 4;
+   else
+      hcnt = 10;
+
+   hptr = (unsigned char*)(prepptr->FramePtr = prepptr->DataPtr - hcnt);
+   prepptr->FrameLength = hcnt + DataCount;
+
+   *hptr++ = WSLIB_BIT_FIN | Opcode;
+   if (DataCount <= 125)
+      *hptr++ = DataCount;
+   else
+   if (DataCount <= 65535)
    {
-      if (frmptr->MrsWriteCount)
-      {
-         /* accumulate total message data transfered */
-#ifdef __VAX
+      *hptr++ = 126;
+      /* network byte order */
+      *hptr++ = (DataCount & 0xff00) >> 8;
+      *hptr++ = DataCount & 0xff;
+   }
+   else
+   {
+      *hptr++ = 127;
+      /* network byte order */
+      *hptr++ = 0;
+      *hptr++ = 0;
+      *hptr++ = 0;
+      *hptr++ = 0;
+      *hptr++ = (DataCount & 0xff000000) >> 24;
+      *hptr++ = (DataCount & 0xff0000) >> 16;
+      *hptr++ = (DataCount & 0xff00) >> 8;
+      *hptr++ = DataCount & 0xff;
+   }
+
+   return (prepptr);
+}
+
+/*****************************************************************************/
+/*
+Prepare a message and return a new block containing the frame(s) of the
+supplied prepared message (or block) followed by that frame.  A block is
+written as-is (see WsLib__WriteAst()) so several messages go using the one
+$QIO, each still arriving at the peer as a discrete message.  The block's
+'DataPtr' and 'DataCount' describe all of the frames and its 'Opcode' is
+zero.  The supplied 'prepptr' may be NULL and is not released (the caller
+retains its reference).  Returns NULL if the opcode is not supported.
+*/
+
+struct WsLibPrepStruct* WsLibMsgAppend
+(
+struct WsLibPrepStruct *prepptr,
+char *DataPtr,
+int DataCount,
+int Opcode
+)
+{
+   int  FrameLength;
+   struct WsLibPrepStruct  *blkptr,
+                           *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!(msgptr = WsLibMsgPrepare (DataPtr, DataCount, Opcode)))
+      return (NULL);
+
+   if (prepptr)
+      FrameLength = prepptr->FrameLength;
+   else
+      FrameLength = 0;
+
+   blkptr = calloc (1, sizeof(struct WsLibPrepStruct) +
+                       FrameLength + msgptr->FrameLength);
+   if (!blkptr) WsLibExit (NULL, FI_LI, vaxc$errno);
+
+   blkptr->DataPtr = blkptr->FramePtr = (char*)blkptr +
+                                        sizeof(struct WsLibPrepStruct);
+   if (FrameLength)
+   {
+      memcpy (blkptr->FramePtr, prepptr->FramePtr, FrameLength);
+      blkptr->FrameCount = prepptr->FrameCount;
+   }
+   memcpy (blkptr->FramePtr + FrameLength, msgptr->FramePtr,
+           msgptr->FrameLength);
+   blkptr->FrameCount++;
+   blkptr->DataCount = blkptr->FrameLength = FrameLength +
+                                             msgptr->FrameLength;
+   blkptr->RefCount = 1;
+
+   WsLibMsgRelease (msgptr);
+
+   return (blkptr);
+}
+
+/*****************************************************************************/
+/*
+Write a message prepared by WsLibMsgPrepare().  As for WsLibWrite() (which
+does all the work) including queued output accounting and AST delivery.  A
+block (see WsLibMsgAppend()) is already framed and so cannot be written by a
+client role (masking) websocket.
+*/
+
+int WsLibWritePrepared
+(
+struct WsLibStruct *wsptr,
+struct WsLibPrepStruct *prepptr,
+void *AstFunction
+)
+{
+   int  status;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!prepptr) return (SS$_BADPARAM);
+
+   if (!prepptr->Opcode && wsptr->RoleClient) return (SS$_BADPARAM);
+
+   wsptr->WritePrepPtr = prepptr;
+   status = WsLibWrite (wsptr, prepptr->DataPtr, prepptr->DataCount,
+                        AstFunction);
+   return (status);
+}
+
+/*****************************************************************************/
+/*
+Release a reference to a prepared message, freeing it with the last.
+*/
+
+void WsLibMsgRelease (struct WsLibPrepStruct *prepptr)
+
+{
+   int  astatus,
+        RefCount;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!prepptr) return;
+
+   astatus = sys$setast (0);
+   if (prepptr->RefCount) prepptr->RefCount--;
+   RefCount = prepptr->RefCount;
+   if (astatus == SS$_WASSET) sys$setast (1);
+
+   if (!RefCount) free (prepptr);
+}
+
+/*****************************************************************************/
+/*
+Write the message to the WebSocket.  Message may be automatically fragmented.
+Can AST back to this function one or more times with asycnchronous I/O.
+*/
+
+static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
+
+{
+   int  cnt, count, hcnt, length, status,
+        DataCount,
+        Headroom;
+   char  *pointer,
+         *DataPtr,
+         *FramePtr;
+   struct WsLibStruct  *wsptr;
+   struct WsLibMsgStruct  *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   msgptr = frmptr->WsLibMsgPtr;
+   wsptr = msgptr->WsLibPtr;
+
+   if (wsptr->QueuedOutput) wsptr->QueuedOutput--;
+
+   if (wsptr->WatchDogIdleSecs)
+      wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
+
+   while (VMSok (frmptr->IOsb.iosb$w_status))
+   {
+      if (frmptr->MrsWriteCount)
+      {
+         /* accumulate total message data transfered */
+#ifdef __VAX
          {
             unsigned long q[2] = { frmptr->MrsWriteCount, 0 };
             lib$addx(&q,&wsptr->OutputCount,&wsptr->OutputCount,0);
@@ -2809,6 +4205,13 @@ static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
          frmptr->MrsWriteCount = 0;
       }
 
+      /* masked frame written in-place (otherwise WsLib__WriteMrsAst()) */
+      if (frmptr->MaskedPtr)
+      {
+         WsLib__PoolPut (wsptr, frmptr->MaskedPtr);
+         frmptr->MaskedPtr = NULL;
+      }
+
       WATCH_WSLIB (wsptr, FI_LI, "WRITE outque:!UL payload:!UL/!UL !AZ",
                    wsptr->QueuedOutput,
                    msgptr->WriteCount, msgptr->DataCount,
@@ -2850,6 +4253,10 @@ static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
       if (frmptr->IOsb.iosb$w_bcnt)
          frmptr->FrameOpcode = 0;
       else
+      if (msgptr->MsgOpcode)
+         /* as prepared (see WsLibMsgPrepare()) */
+         frmptr->FrameOpcode = msgptr->MsgOpcode;
+      else
       if (wsptr->SetAscii || wsptr->SetUtf8)
          frmptr->FrameOpcode = WSLIB_OPCODE_TEXT;
       else
@@ -2870,7 +4277,11 @@ static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
                    DataCount);
 
       hcnt = 0;
-      frmptr->FrameHeader[hcnt++] = frmptr->FrameFinBit | frmptr->FrameOpcode;
+      frmptr->FrameHeader[hcnt] = frmptr->FrameFinBit | frmptr->FrameOpcode;
+      /* permessage-deflate, RSV1 on the first frame of a message only */
+      if (msgptr->MsgDeflate && !msgptr->WriteCount)
+         frmptr->FrameHeader[hcnt] |= WSLIB_BIT_RSV1;
+      hcnt++;
 
       if (DataCount <= 125)
          frmptr->FrameHeader[hcnt++] = frmptr->FrameMaskBit + DataCount;
@@ -2903,23 +4314,105 @@ static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
          frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[2];
          frmptr->FrameHeader[hcnt++] = frmptr->MaskingKey[3];
 
-         /* never apply apply the masking key to original data */
-         if (!(frmptr->MaskedPtr = msgptr->Utf8Ptr))
+         /* never apply the masking key to original data */
+         if (DataCount <= 125)
+         {
+            /* for efficiency mask directly into the header */
+            WsLib__Mask (frmptr->FrameHeader+hcnt, (unsigned char*)DataPtr,
+                         DataCount, frmptr->MaskingKey, &frmptr->MaskCount);
+            hcnt += DataCount;
+            frmptr->MrsWriteCount = DataCount;
+            /* indicate that it's all contained in the header */
+            DataCount = 0;
+         }
+         else
+         if (msgptr->Utf8Ptr || msgptr->DeflatePtr)
+         {
+            /* internal buffer (not original data) so mask in-situ */
+            WsLib__Mask ((unsigned char*)DataPtr, (unsigned char*)DataPtr,
+                         DataCount, frmptr->MaskingKey, &frmptr->MaskCount);
+         }
+         else
          {
-            /* allocate a buffer for masked data */
-            frmptr->MaskedPtr = calloc (1, DataCount); 
-            if (!frmptr->MaskedPtr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+            /* buffer for masked data (released by WsLib__WriteMrsAst()) */
+            frmptr->MaskedPtr = WsLib__PoolGet (wsptr, WSLIB_HEADROOM +
+                                                       DataCount);
+            WsLib__Mask ((unsigned char*)frmptr->MaskedPtr + WSLIB_HEADROOM,
+                         (unsigned char*)DataPtr, DataCount,
+                         frmptr->MaskingKey, &frmptr->MaskCount);
+            DataPtr = frmptr->MaskedPtr + WSLIB_HEADROOM;
          }
-         for (cnt = 0; cnt < DataCount; cnt++)
-            frmptr->MaskedPtr[cnt] = DataPtr[cnt] ^
-                                     frmptr->MaskingKey[cnt&0x03];
-         DataPtr = frmptr->MaskedPtr;
       }
 
       /*********/
       /* write */
       /*********/
 
+      /* storage available in front of the data for the frame header */
+      if (frmptr->MaskedPtr)
+         Headroom = WSLIB_HEADROOM;
+      else
+      if (msgptr->Utf8Ptr || msgptr->DeflatePtr)
+         /* internal buffer so preceding (already written) data is fair game */
+         Headroom = WSLIB_HEADROOM + msgptr->WriteCount;
+      else
+      if (!msgptr->WriteCount)
+         Headroom = msgptr->Headroom;
+      else
+         Headroom = 0;
+
+      FramePtr = NULL;
+      if (msgptr->PrepPtr && !msgptr->PrepPtr->Opcode)
+      {
+         /* block of frames (see WsLibMsgAppend()) written as-is */
+         FramePtr = DataPtr;
+         if (DataCount > wsptr->OutputMrs) DataCount = wsptr->OutputMrs;
+         hcnt = DataCount;
+      }
+      else
+      if (msgptr->PrepPtr &&
+          !msgptr->WriteCount &&
+          !frmptr->FrameMaskBit &&
+          frmptr->FrameFinBit &&
+          msgptr->PrepPtr->FrameLength <= wsptr->OutputMrs)
+      {
+         /* prepared frame is identical so write it as-is (shared, no copy) */
+         FramePtr = msgptr->PrepPtr->FramePtr;
+         hcnt = msgptr->PrepPtr->FrameLength;
+      }
+      else
+      if (DataCount > 125 && hcnt <= Headroom &&
+          hcnt + DataCount <= wsptr->OutputMrs)
+      {
+         /* frame the data in-place */
+         FramePtr = DataPtr - hcnt;
+         memcpy (FramePtr, frmptr->FrameHeader, hcnt);
+         hcnt += DataCount;
+      }
+
+      if (FramePtr)
+      {
+         /* the header and data are written using the one I/O */
+         frmptr->MrsWriteCount = DataCount;
+         DataCount = 0;
+
+         if (msgptr->AstFunction)
+         {
+            status = sys$qio (WsLibEfnNoWait, wsptr->OutputChannel,
+                              IO$_WRITELBLK | IO$M_READERCHECK,
+                              &frmptr->IOsb, WsLib__WriteAst, frmptr,
+                              FramePtr, hcnt, 0, 0, 0, 0);
+            if (VMSok(status)) wsptr->QueuedOutput++;
+            return;
+         }
+
+         sys$qiow (WsLibEfnWait, wsptr->OutputChannel,
+                   IO$_WRITELBLK | IO$M_READERCHECK,
+                   &frmptr->IOsb, 0, 0,
+                   FramePtr, hcnt, 0, 0, 0, 0);
+         continue;
+      }
+
       if (DataCount && DataCount <= 125)
       {
          /* for efficiency append the data to the header */
@@ -3002,8 +4495,33 @@ static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
       wsptr->OutputDataDsc.dsc$w_length = length;
    }
 
-   if (msgptr->Utf8Ptr) free (msgptr->Utf8Ptr);
-   free (msgptr);
+   if (frmptr->MaskedPtr) WsLib__PoolPut (wsptr, frmptr->MaskedPtr);
+   if (msgptr->Utf8Ptr) WsLib__PoolPut (wsptr, msgptr->Utf8Ptr);
+   if (msgptr->DeflatePtr) WsLib__PoolPut (wsptr, msgptr->DeflatePtr);
+   if (msgptr->PrepPtr) WsLibMsgRelease (msgptr->PrepPtr);
+
+   /* queued output accounting (see WsLibSetOutputLimit()) */
+   if (wsptr->OutputQueuedBytes >= msgptr->QueuedCount)
+      wsptr->OutputQueuedBytes -= msgptr->QueuedCount;
+   else
+      wsptr->OutputQueuedBytes = 0;
+   if (wsptr->OutputQueuedMsgs) wsptr->OutputQueuedMsgs--;
+
+   WsLib__MsgPut (msgptr);
+
+   /* a zero limit is no limit */
+   if (wsptr->OutputBlocked &&
+       (!wsptr->OutputByteLimit ||
+        wsptr->OutputQueuedBytes <= wsptr->OutputByteLimit / 2) &&
+       (!wsptr->OutputMsgLimit ||
+        wsptr->OutputQueuedMsgs <= wsptr->OutputMsgLimit / 2))
+   {
+      /* drained below the low-water mark */
+      WATCH_WSLIB (wsptr, FI_LI, "WRITABLE");
+      wsptr->OutputBlocked = 0;
+      if (wsptr->WritableCallbackFunction)
+         (*wsptr->WritableCallbackFunction)(wsptr);
+   }
 
    if (wsptr->WatchDogIdleSecs)
       wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
@@ -3014,8 +4532,9 @@ static void WsLib__WriteAst (struct WsLibFrmStruct *frmptr)
 /*****************************************************************************/
 /*
 Write the frame data in record MRS sized chunks (may only be one).  This
-function is only used for payload greater than 125 bytes.  For 125 bytes or
-less (including empty frames) it's all handled by WsLib__WriteAst().
+function is only used for payload greater than 125 bytes that could not be
+framed in-place.  For 125 bytes or less (including empty frames) it's all
+handled by WsLib__WriteAst().
 */
 
 static void WsLib__WriteMrsAst (struct WsLibFrmStruct *frmptr)
@@ -3081,7 +4600,7 @@ static void WsLib__WriteMrsAst (struct WsLibFrmStruct *frmptr)
 
    if (frmptr->MaskedPtr)
    {
-      free (frmptr->MaskedPtr);
+      WsLib__PoolPut (wsptr, frmptr->MaskedPtr);
       frmptr->MaskedPtr = NULL;
    }
 
@@ -3431,6 +4950,7 @@ int CloseSecs
       if (!(wsptr->WatchDogCloseSecs = CloseSecs))
          wsptr->WatchDogCloseSecs = WatchDogCloseSecs;
       wsptr->WatchDogCloseTime = CurrentTime + wsptr->WatchDogCloseSecs;
+      WsLib__WatchDogArm (wsptr);
    }
    else
    {
@@ -3462,6 +4982,7 @@ int IdleSecs
       if (!(wsptr->WatchDogIdleSecs = IdleSecs))
          wsptr->WatchDogIdleSecs = WatchDogIdleSecs;
       wsptr->WatchDogIdleTime = CurrentTime + wsptr->WatchDogIdleSecs;
+      WsLib__WatchDogArm (wsptr);
    }
    else
    {
@@ -3493,6 +5014,7 @@ int PingSecs
       if (!(wsptr->WatchDogPingSecs = PingSecs))
          wsptr->WatchDogPingSecs = WatchDogPingSecs;
       wsptr->WatchDogPingTime = CurrentTime + wsptr->WatchDogPingSecs;
+      WsLib__WatchDogArm (wsptr);
    }
    else
    {
@@ -3587,6 +5109,7 @@ int WakeSecs
       if (!(wsptr->WatchDogWakeSecs = WakeSecs))
          wsptr->WatchDogWakeSecs = WatchDogWakeSecs;
       wsptr->WatchDogWakeTime = CurrentTime + wsptr->WatchDogWakeSecs;
+      WsLib__WatchDogArm (wsptr);
 
       PrevCallback = wsptr->WakeCallbackFunction;
       wsptr->WakeCallbackFunction = AstFunction;
@@ -3606,157 +5129,336 @@ int WakeSecs
 
 /*****************************************************************************/
 /*
-Set/reset the error callback function.  Returns the previous callback pointer.
+Set the high-water marks for queued (written but not yet completed) output.
+Zero is no limit.  See WsLibWrite() and WsLib__WriteAst().
 */
 
-void* WsLibSetMsgCallback
+void WsLibSetOutputLimit
 (
 struct WsLibStruct *wsptr,
-void *AstFunction
+int ByteLimit,
+int MsgLimit
 )
 {
-   void  *PrevCallback;
-
    /*********/
    /* begin */
    /*********/
 
-   PrevCallback = wsptr->MsgCallbackFunction;
-   wsptr->MsgCallbackFunction = AstFunction;
-   return (PrevCallback);
+   if (ByteLimit < 0) ByteLimit = 0;
+   if (MsgLimit < 0) MsgLimit = 0;
+   wsptr->OutputByteLimit = ByteLimit;
+   wsptr->OutputMsgLimit = MsgLimit;
 }
 
 /*****************************************************************************/
 /*
-Set wsLIB message data.  The 'FormatString' must be a $FAO compiliant
-null-terminated string, with following parametersif required.  Activate any set
-message callback.
+Set/reset the writable callback function.  Called when queued output that had
+reached a high-water mark has drained to half.  Returns the previous callback
+pointer.
 */
 
-static void WsLib__MsgCallback
+void* WsLibSetWritableCallback
 (
 struct WsLibStruct *wsptr,
-int LineNumber,
-int VmsStatus,
-char *FormatString,
-...
+void *AstFunction
 )
 {
-   static $DESCRIPTOR (FormatFaoDsc, "");
-
-   int  argcnt, cnt, status;
-   unsigned short  slen = 0;
-   unsigned long  *vecptr;
-   unsigned long  FaoVector [32];
-   char  *cptr, *sptr, *zptr;
-   char  FormatBuffer [128];
-   va_list  argptr;
+   void  *PrevCallback;
 
    /*********/
    /* begin */
    /*********/
 
-   va_count (argcnt);
-
-   /* bit of a sanity check */
-   if (argcnt-4 > 32) WsLibExit (wsptr, FI_LI, SS$_BUGCHECK);
-   cnt = 0;
-   /* some VERY basic sanity checking */
-   for (cptr = FormatString; *cptr; cptr++)
-   {
-      if (*cptr != '!') continue;
-      cptr++;
-      if (*cptr == '!') continue;
-      cnt++;
-      if (*cptr == '#') cnt++;
-      if (*(USHORTPTR)cptr == '%T') cnt++; 
-      if (*(USHORTPTR)cptr == '%D') cnt++; 
-   }
-   if (argcnt-4 != cnt) WsLibExit (wsptr, FI_LI, SS$_BUGCHECK);
-
-   zptr = (sptr = FormatBuffer) + sizeof(FormatBuffer)-1;
-   for (cptr = "%X!8XL "; *cptr; *sptr++ = *cptr++);
-   for (cptr = FormatString; *cptr && sptr < zptr; *sptr++ = *cptr++);
-   *sptr = '\0';
-
-   FormatFaoDsc.dsc$a_pointer = FormatBuffer;
-   FormatFaoDsc.dsc$w_length = sptr - FormatBuffer;
-
-   vecptr = FaoVector;
-   *vecptr++ = VmsStatus;
-   va_start (argptr, FormatString);
-   for (argcnt -= 4; argcnt; argcnt--)
-      *vecptr++ = va_arg (argptr, unsigned long);
-   va_end (argptr);
-
-   wsptr->MsgDsc.dsc$b_class = DSC$K_CLASS_S;
-   wsptr->MsgDsc.dsc$b_dtype = DSC$K_DTYPE_T;
-
-   for (;;)
-   {
-      if (wsptr->MsgStringSize)
-      {
-         wsptr->MsgDsc.dsc$a_pointer = wsptr->MsgStringPtr;
-         wsptr->MsgDsc.dsc$w_length = wsptr->MsgStringSize;
-
-         status = sys$faol (&FormatFaoDsc, &slen, &wsptr->MsgDsc, &FaoVector);
-         if (VMSnok (status)) WsLibExit (NULL, FI_LI, status);
-         if (status != SS$_BUFFEROVF) break;
-      }
-
-      if (wsptr->MsgStringSize) free (wsptr->MsgStringPtr);
-      wsptr->MsgStringSize += 127;
-      wsptr->MsgStringPtr = calloc (1, wsptr->MsgStringSize+1);
-      if (!wsptr->MsgStringPtr) WsLibExit (NULL, FI_LI, vaxc$errno);
-   }
-
-   wsptr->MsgStringPtr[wsptr->MsgStringLength=slen] = '\0';
-   wsptr->MsgDsc.dsc$w_length = slen;
-
-   wsptr->MsgLineNumber = LineNumber;
-   sys$gettim (&wsptr->MsgBinTime);
-
-   if (wsptr->MsgCallbackFunction) (*wsptr->MsgCallbackFunction)(wsptr);
+   PrevCallback = wsptr->WritableCallbackFunction;
+   wsptr->WritableCallbackFunction = AstFunction;
+   return (PrevCallback);
 }
 
-/****************************************************************************/
+/*****************************************************************************/
 /*
-Return a pointer to the string descriptor of the latest error string.
+Return true if queued output is below the high-water marks.
 */
 
-struct dsc$descriptor_s* WsLibMsgDsc (struct WsLibStruct *wsptr)
+int WsLibIsWritable (struct WsLibStruct *wsptr)
 
 {
    /*********/
    /* begin */
    /*********/
 
-   return (&wsptr->MsgDsc);
+   return (!wsptr->OutputBlocked);
 }
 
-/****************************************************************************/
+/*****************************************************************************/
 /*
-Return a pointer to the latest error string.
+Return the number of bytes of queued output (and optionally messages).
 */
 
-char* WsLibMsgString (struct WsLibStruct *wsptr)
-
+int WsLibOutputQueued
+(
+struct WsLibStruct *wsptr,
+int *MsgCountPtr
+)
 {
    /*********/
    /* begin */
    /*********/
 
-   return (wsptr->MsgStringPtr);
+   if (MsgCountPtr) *MsgCountPtr = wsptr->OutputQueuedMsgs;
+   return (wsptr->OutputQueuedBytes);
 }
 
-/****************************************************************************/
+/*****************************************************************************/
 /*
-Return the wsLIB source code line at which the last error occured.
+Enable (or disable) acceptance of a client permessage-deflate offer for
+subsequently created WebSockets.  'WindowBits' 9 to 15 sets the maximum (server)
+compression window, zero disables.  'NoContextTakeover' resets compression
+history for each message.  Only effective if compiled with WSLIB_ZLIB.
 */
 
-int WsLibMsgLineNumber (struct WsLibStruct *wsptr)
-
-{
+void WsLibSetDeflate
+(
+int WindowBits,
+int NoContextTakeover
+)
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (WindowBits <= 0)
+      WindowBits = 0;
+   else
+   if (WindowBits < 9)
+      WindowBits = 9;
+   else
+   if (WindowBits > 15)
+      WindowBits = 15;
+
+   DeflateWindowBits = WindowBits;
+   DeflateNoContext = NoContextTakeover;
+}
+
+/*****************************************************************************/
+/*
+Set the compression level (1 to 9) of permessage-deflate output.  Zero sends
+messages uncompressed (compressed input is still accepted).  If a WebSocket is
+not specified then set the global value.  Returns SS$_UNSUPPORTED if the
+extension was not negotiated for the WebSocket.
+*/
+
+int WsLibSetDeflateLevel
+(
+struct WsLibStruct *wsptr,
+int Level
+)
+{
+#ifdef WSLIB_ZLIB
+   z_stream  *zsptr;
+#endif
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (Level < 0) Level = 0;
+   if (Level > 9) Level = 9;
+
+   if (!wsptr)
+   {
+      /* set global value */
+      DeflateLevel = Level;
+      return (SS$_NORMAL);
+   }
+
+   if (!wsptr->DeflateStreamPtr) return (SS$_UNSUPPORTED);
+
+#ifdef WSLIB_ZLIB
+   if (Level && Level != wsptr->DeflateLevel)
+   {
+      /* a restarted compression stream is always decompressable */
+      zsptr = (z_stream*)wsptr->DeflateStreamPtr;
+      deflateEnd (zsptr);
+      memset (zsptr, 0, sizeof(z_stream));
+      if (deflateInit2 (zsptr, Level, Z_DEFLATED, -wsptr->DeflateWindowBits,
+                        8, Z_DEFAULT_STRATEGY) != Z_OK)
+         WsLibExit (wsptr, FI_LI, SS$_BUGCHECK);
+   }
+#endif
+
+   wsptr->DeflateLevel = Level;
+
+   return (SS$_NORMAL);
+}
+
+/*****************************************************************************/
+/*
+Return true if permessage-deflate was negotiated for the WebSocket.
+*/
+
+int WsLibIsDeflate (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return (wsptr->DeflateStreamPtr != NULL);
+}
+
+/*****************************************************************************/
+/*
+Set/reset the error callback function.  Returns the previous callback pointer.
+*/
+
+void* WsLibSetMsgCallback
+(
+struct WsLibStruct *wsptr,
+void *AstFunction
+)
+{
+   void  *PrevCallback;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   PrevCallback = wsptr->MsgCallbackFunction;
+   wsptr->MsgCallbackFunction = AstFunction;
+   return (PrevCallback);
+}
+
+/*****************************************************************************/
+/*
+Set wsLIB message data.  The 'FormatString' must be a $FAO compiliant
+null-terminated string, with following parametersif required.  Activate any set
+message callback.
+*/
+
+static void WsLib__MsgCallback
+(
+struct WsLibStruct *wsptr,
+int LineNumber,
+int VmsStatus,
+char *FormatString,
+...
+)
+{
+   static $DESCRIPTOR (FormatFaoDsc, "");
+
+   int  argcnt, cnt, status;
+   unsigned short  slen = 0;
+   unsigned long  *vecptr;
+   unsigned long  FaoVector [32];
+   char  *cptr, *sptr, *zptr;
+   char  FormatBuffer [128];
+   va_list  argptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   va_count (argcnt);
+
+   /* bit of a sanity check */
+   if (argcnt-4 > 32) WsLibExit (wsptr, FI_LI, SS$_BUGCHECK);
+   cnt = 0;
+   /* some VERY basic sanity checking */
+   for (cptr = FormatString; *cptr; cptr++)
+   {
+      if (*cptr != '!') continue;
+      cptr++;
+      if (*cptr == '!') continue;
+      cnt++;
+      if (*cptr == '#') cnt++;
+      if (*(USHORTPTR)cptr == '%T') cnt++; 
+      if (*(USHORTPTR)cptr == '%D') cnt++; 
+   }
+   if (argcnt-4 != cnt) WsLibExit (wsptr, FI_LI, SS$_BUGCHECK);
+
+   zptr = (sptr = FormatBuffer) + sizeof(FormatBuffer)-1;
+   for (cptr = "%X!8XL "; *cptr; *sptr++ = *cptr++);
+   for (cptr = FormatString; *cptr && sptr < zptr; *sptr++ = *cptr++);
+   *sptr = '\0';
+
+   FormatFaoDsc.dsc$a_pointer = FormatBuffer;
+   FormatFaoDsc.dsc$w_length = sptr - FormatBuffer;
+
+   vecptr = FaoVector;
+   *vecptr++ = VmsStatus;
+   va_start (argptr, FormatString);
+   for (argcnt -= 4; argcnt; argcnt--)
+      *vecptr++ = va_arg (argptr, unsigned long);
+   va_end (argptr);
+
+   wsptr->MsgDsc.dsc$b_class = DSC$K_CLASS_S;
+   wsptr->MsgDsc.dsc$b_dtype = DSC$K_DTYPE_T;
+
+   for (;;)
+   {
+      if (wsptr->MsgStringSize)
+      {
+         wsptr->MsgDsc.dsc$a_pointer = wsptr->MsgStringPtr;
+         wsptr->MsgDsc.dsc$w_length = wsptr->MsgStringSize;
+
+         status = sys$faol (&FormatFaoDsc, &slen, &wsptr->MsgDsc, &FaoVector);
+         if (VMSnok (status)) WsLibExit (NULL, FI_LI, status);
+         if (status != SS$_BUFFEROVF) break;
+      }
+
+      if (wsptr->MsgStringSize) free (wsptr->MsgStringPtr);
+      wsptr->MsgStringSize += 127;
+      wsptr->MsgStringPtr = calloc (1, wsptr->MsgStringSize+1);
+      if (!wsptr->MsgStringPtr) WsLibExit (NULL, FI_LI, vaxc$errno);
+   }
+
+   wsptr->MsgStringPtr[wsptr->MsgStringLength=slen] = '\0';
+   wsptr->MsgDsc.dsc$w_length = slen;
+
+   wsptr->MsgLineNumber = LineNumber;
+   sys$gettim (&wsptr->MsgBinTime);
+
+   if (wsptr->MsgCallbackFunction) (*wsptr->MsgCallbackFunction)(wsptr);
+}
+
+/****************************************************************************/
+/*
+Return a pointer to the string descriptor of the latest error string.
+*/
+
+struct dsc$descriptor_s* WsLibMsgDsc (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return (&wsptr->MsgDsc);
+}
+
+/****************************************************************************/
+/*
+Return a pointer to the latest error string.
+*/
+
+char* WsLibMsgString (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return (wsptr->MsgStringPtr);
+}
+
+/****************************************************************************/
+/*
+Return the wsLIB source code line at which the last error occured.
+*/
+
+int WsLibMsgLineNumber (struct WsLibStruct *wsptr)
+
+{
    /*********/
    /* begin */
    /*********/
@@ -3847,6 +5549,7 @@ char SubsChar
          if ((*cptr & 0xc0) != 0x80) goto utf8_nbg;
          if (++cptr >= zptr) goto utf8_nbg;
          if ((*cptr & 0xc0) != 0x80) goto utf8_nbg;
+         cptr++;
          if (SubsChar) *sptr++ = SubsChar;
       }
       else
@@ -3857,6 +5560,7 @@ char SubsChar
          if ((*cptr & 0xc0) != 0x80) goto utf8_nbg;
          if (++cptr >= zptr) goto utf8_nbg;
          if ((*cptr & 0xc0) != 0x80) goto utf8_nbg;
+         cptr++;
          if (SubsChar) *sptr++ = SubsChar;
       }
       else
@@ -3868,7 +5572,7 @@ char SubsChar
             /* out-of-range character */
             if (++cptr >= zptr) goto utf8_nbg;
             if ((*cptr & 0xc0) != 0x80) goto utf8_nbg;
-            if (++cptr >= zptr) goto utf8_nbg;
+            cptr++;
             if (SubsChar) *sptr++ = SubsChar;
          }
          else
@@ -3890,212 +5594,1182 @@ char SubsChar
    }
    *sptr = '\0';
 
-   return (sptr - (unsigned char*)UtfPtr);
+   return (sptr - (unsigned char*)UtfPtr);
+
+   utf8_nbg:
+      return (-1);
+}
+
+/****************************************************************************/
+/*
+Given a descriptor of 8 bit ASCII convert it to UTF-8.  Can be done in-situ.
+The output descriptor must be provided even if it points to the same storage as
+the input descriptor.  Return the length of the converted string or -1 to
+indicated a conversion error.
+
+*/
+
+int WsLibToUtf8Dsc
+(
+struct dsc$descriptor_s *InDsc,
+struct dsc$descriptor_s *OutDsc
+)
+{
+   int  len;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (InDsc->dsc$b_class != DSC$K_CLASS_S &&
+       InDsc->dsc$b_dtype != DSC$K_DTYPE_T) return (LIB$_INVSTRDES);
+
+   if (OutDsc->dsc$b_class != DSC$K_CLASS_S &&
+       OutDsc->dsc$b_dtype != DSC$K_DTYPE_T) return (LIB$_INVSTRDES);
+
+   len = WsLibToUtf8 (InDsc->dsc$a_pointer, InDsc->dsc$w_length,
+                      OutDsc->dsc$a_pointer, OutDsc->dsc$w_length);
+
+   if (len == -1) return (SS$_ABORT);
+
+   return (SS$_NORMAL);
+}
+
+/****************************************************************************/
+/*
+Given a buffer of 8 bit ASCII text convert it to UTF-8.  This can be done
+in-situ with the worst-case the buffer space needs to be two times in size
+(i.e. every character has the hi bit set requiring a leading UTF-8 byte). 
+End-of-string is indicated by text-length not a null-character, however the
+resultant string is nulled.  Return the length of the converted string.  Return
+-1 if the buffer space will be too small.
+*/
+
+int WsLibToUtf8
+(
+char *InPtr,
+int InLength,
+char *OutPtr,
+int SizeOfOut
+)
+{
+   int  Utf8Count = 0;
+   char  *cptr, *czptr, *sptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!InPtr) return (-1);
+
+   if (InLength == -1) InLength = strlen(InPtr);
+
+   Utf8Count = WsLib__Utf8Count (InPtr, InLength);
+
+   if (!Utf8Count)
+   {
+      if (!OutPtr) return (InLength);
+      if (OutPtr == InPtr) return (InLength);
+      /* just copy to output buffer */
+      if (InLength >= SizeOfOut - 1) return (-1);
+      memcpy (OutPtr, InPtr, InLength);
+      OutPtr[InLength] = '\0'; 
+      return (InLength);
+   }
+
+   if (InLength + Utf8Count >= SizeOfOut - 1) return (-1);
+
+   if (OutPtr && OutPtr != InPtr)
+   {
+      /* separate buffer so can be encoded front-to-back */
+      WsLib__Utf8Encode ((unsigned char*)OutPtr, (unsigned char*)InPtr,
+                         InLength);
+      OutPtr[InLength + Utf8Count] = '\0';
+      return (InLength + Utf8Count);
+   }
+
+   /* in-situ so must be expanded back-to-front */
+   cptr = (czptr = InPtr) + InLength - 1;
+   if (!(sptr = OutPtr)) sptr = InPtr;
+   sptr += InLength - 1;
+   sptr += Utf8Count + 1;
+   *sptr-- = '\0';
+   while (cptr >= czptr)
+   {
+      if (*cptr & 0x80)
+      {
+         *sptr-- = (*cptr & 0x3f) | 0x80;
+         *sptr-- = ((*cptr-- & 0xc0) >> 6) | 0xc0;
+      }
+      else
+         *sptr-- = *cptr--;
+   }
+
+   return (InLength + Utf8Count);
+}
+
+/****************************************************************************/
+/*
+Return the number of 8 bit characters (i.e. those requiring a second byte when
+UTF-8 encoded).  Words containing only 7 bit ASCII are skipped with a single
+test and the high bits of the others summed using a multiply.
+*/
+
+static int WsLib__Utf8Count
+(
+char *DataPtr,
+int DataCount
+)
+{
+   int  Utf8Count = 0;
+   unsigned char  *cptr, *czptr;
+   WSLIB_MASK_WORD  HiBits, Ones, word;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   czptr = (cptr = (unsigned char*)DataPtr) + DataCount;
+
+   if (DataCount >= sizeof(WSLIB_MASK_WORD))
+   {
+      memset (&HiBits, 0x80, sizeof(HiBits));
+      memset (&Ones, 0x01, sizeof(Ones));
+      while (czptr - cptr >= sizeof(WSLIB_MASK_WORD))
+      {
+         word = *(__unaligned WSLIB_MASK_WORD*)cptr & HiBits;
+         cptr += sizeof(WSLIB_MASK_WORD);
+         /* one in each byte with the high bit, summed into the top byte */
+         if (word)
+            Utf8Count += (int)(((word >> 7) * Ones) >>
+                               ((sizeof(WSLIB_MASK_WORD) - 1) * 8));
+      }
+   }
+
+   while (cptr < czptr) if (*cptr++ & 0x80) Utf8Count++;
+
+   return (Utf8Count);
+}
+
+/****************************************************************************/
+/*
+Encode 8 bit ASCII at 'SrcPtr' to UTF-8 at 'DstPtr' (which must be a separate
+buffer of sufficient size, see WsLib__Utf8Count()).  Words of 7 bit ASCII are
+moved as a word, only those containing 8 bit characters are expanded bytewise.
+*/
+
+static void WsLib__Utf8Encode
+(
+unsigned char *DstPtr,
+unsigned char *SrcPtr,
+int SrcCount
+)
+{
+   unsigned char  *cptr, *czptr, *sptr, *wzptr;
+   WSLIB_MASK_WORD  HiBits, word;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   sptr = DstPtr;
+   czptr = (cptr = SrcPtr) + SrcCount;
+
+   if (SrcCount >= sizeof(WSLIB_MASK_WORD))
+   {
+      memset (&HiBits, 0x80, sizeof(HiBits));
+      while (czptr - cptr >= sizeof(WSLIB_MASK_WORD))
+      {
+         word = *(__unaligned WSLIB_MASK_WORD*)cptr;
+         if (!(word & HiBits))
+         {
+            *(__unaligned WSLIB_MASK_WORD*)sptr = word;
+            cptr += sizeof(WSLIB_MASK_WORD);
+            sptr += sizeof(WSLIB_MASK_WORD);
+            continue;
+         }
+         for (wzptr = cptr + sizeof(WSLIB_MASK_WORD); cptr < wzptr; cptr++)
+         {
+            if (*cptr & 0x80)
+            {
+               *sptr++ = ((*cptr & 0xc0) >> 6) | 0xc0;
+               *sptr++ = (*cptr & 0x3f) | 0x80;
+            }
+            else
+               *sptr++ = *cptr;
+         }
+      }
+   }
+
+   while (cptr < czptr)
+   {
+      if (*cptr & 0x80)
+      {
+         *sptr++ = ((*cptr & 0xc0) >> 6) | 0xc0;
+         *sptr++ = (*cptr++ & 0x3f) | 0x80;
+      }
+      else
+         *sptr++ = *cptr++;
+   }
+}
+
+/****************************************************************************/
+/*
+Called with a frame pointer after reading UTF-8 data from the client.
+In a single pass over the data just read this applies any masking key, parses
+the UTF-8 (received so far, i.e. not necessarily a complete message) to ensure
+it appears legal, and (if WsLibSetAscii()) decodes it to 8 bit ASCII.  Decoded
+data is written in-situ from ->DecodeCount (which can never overtake the data
+being read) with code-points above 0xff ignored, as with WsLibFromUtf8().  When
+not decoding the unmasked data is written back unchanged.  Between code-points
+machine words of 7 bit ASCII are unmasked and moved without parsing.  Provides
+"fast fail" on illegal UTF-8.  Return true if legal, false if not.  With a
+zero byte count checks the code-point at end of message is complete.
+
+Algorithm and essential code ...
+
+Copyright (c) 2008-2009 Bjoern Hoehrmann <bjoern@hoehrmann.de>
+See http://bjoern.hoehrmann.de/utf-8/decoder/dfa/ for details.
+*/
+
+static int WsLib__Utf8Decode (struct WsLibFrmStruct *frmptr)
+
+{
+static const unsigned char  utf8d[] =
+{
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 00..1f
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 20..3f
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 40..5f
+  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 60..7f
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, // 80..9f
+  7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, // a0..bf
+  8,8,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, // c0..df
+  0xa,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x4,0x3,0x3, // e0..ef
+  0xb,0x6,0x6,0x6,0x5,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8, // f0..ff
+  0x0,0x1,0x2,0x3,0x5,0x8,0x7,0x1,0x1,0x1,0x4,0x6,0x1,0x1,0x1,0x1, // s0..s0
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,1,1,1,1,1,0,1,0,1,1,1,1,1,1, // s1..s2
+  1,2,1,1,1,1,1,2,1,2,1,1,1,1,1,1,1,1,1,1,1,1,1,2,1,1,1,1,1,1,1,1, // s3..s4
+  1,2,1,1,1,1,1,1,1,2,1,1,1,1,1,1,1,1,1,1,1,1,1,3,1,3,1,1,1,1,1,1, // s5..s6
+  1,3,1,1,1,1,1,3,1,3,1,1,1,1,1,1,1,3,1,1,1,1,1,1,1,1,1,1,1,1,1,1, // s7..s8
+};
+
+   static unsigned char  NoMaskingKey [4];
+
+   int  idx, mcnt,
+        Decode,
+        Utf8Count = 0;
+   unsigned int  byte, codep, state, type;
+   unsigned char  *cptr, *czptr, *kptr, *sptr;
+   unsigned char  KeyBytes [sizeof(WSLIB_MASK_WORD)+3];
+   WSLIB_MASK_WORD  HiBits, word;
+   WSLIB_MASK_WORD  KeyWord [4];
+   struct WsLibMsgStruct  *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   msgptr = frmptr->WsLibMsgPtr;
+   state = msgptr->Utf8State;
+
+   if (!frmptr->IOsb.iosb$w_bcnt)
+   {
+      /* checking code-point at end of message */
+      return (state == 0);
+   }
+
+   /* fragment lists are delivered as UTF-8 */
+   Decode = msgptr->WsLibPtr->SetAscii && !msgptr->IovMode;
+
+   codep = msgptr->Utf8Codep;
+   mcnt = frmptr->MaskCount;
+   if (frmptr->FrameMaskBit)
+      kptr = frmptr->MaskingKey;
+   else
+      kptr = NoMaskingKey;
+
+   cptr = (unsigned char*)frmptr->DataPtr + frmptr->DataCount;
+   czptr = cptr + frmptr->IOsb.iosb$w_bcnt;
+   sptr = (unsigned char*)frmptr->DataPtr + frmptr->DecodeCount;
+
+   if (czptr - cptr >= sizeof(WSLIB_MASK_WORD))
+   {
+      /* masking key words for each of the four key offsets */
+      for (idx = 0; idx < sizeof(KeyBytes); idx++)
+         KeyBytes[idx] = kptr[idx&0x3];
+      for (idx = 0; idx < 4; idx++)
+         memcpy (&KeyWord[idx], KeyBytes+idx, sizeof(WSLIB_MASK_WORD));
+      memset (&HiBits, 0x80, sizeof(HiBits));
+   }
+
+   byte = 0;
+   while (cptr < czptr)
+   {
+      /* if between code-points (and the last was 7 bit) try for a word */
+      if (!state && byte < 0x80 && czptr - cptr >= sizeof(WSLIB_MASK_WORD))
+      {
+         word = *(__unaligned WSLIB_MASK_WORD*)cptr ^ KeyWord[mcnt&0x3];
+         if (!(word & HiBits))
+         {
+            *(__unaligned WSLIB_MASK_WORD*)sptr = word;
+            cptr += sizeof(WSLIB_MASK_WORD);
+            sptr += sizeof(WSLIB_MASK_WORD);
+            mcnt += sizeof(WSLIB_MASK_WORD);
+            Utf8Count += sizeof(WSLIB_MASK_WORD);
+            continue;
+         }
+      }
+
+      byte = *cptr++ ^ kptr[mcnt++&0x3];
+      type = utf8d[byte];
+      if (state)
+         codep = (byte & 0x3f) | (codep << 6);
+      else
+         codep = (0xff >> type) & byte;
+      state = utf8d[256+(state*16)+type];
+
+      if (state == 1) break;
+
+      if (Decode)
+      {
+         if (!state)
+         {
+            /* 8 bit ASCII 0 to 255, ignore anything else */
+            if (codep <= 0xff) *sptr++ = codep;
+            Utf8Count++;
+         }
+      }
+      else
+      {
+         *sptr++ = byte;
+         if (!state) Utf8Count++;
+      }
+   }
+
+   frmptr->MaskCount = mcnt;
+   frmptr->DecodeCount = sptr - (unsigned char*)frmptr->DataPtr;
+   msgptr->Utf8Codep = codep;
+   msgptr->Utf8State = state;
+   msgptr->Utf8Count += Utf8Count;
+
+   return (state != 1);
+}
+
+/*****************************************************************************/
+/*
+permessage-deflate (RFC 7692) requires wsLIB to be compiled with WSLIB_ZLIB and
+linked against zlib.  The WebSocket upgrade itself is performed by the server,
+so the offer arrives as the CGI variable HTTP_SEC_WEBSOCKET_EXTENSIONS and any
+acceptance is returned as a header of the "101 Switching Protocols" response.
+The first acceptable offer is accepted.  Write into the supplied buffer the
+response header (or nothing).  Return true if accepted, false if not.
+*/
+
+#ifdef WSLIB_ZLIB
+
+static int WsLib__DeflateOffer
+(
+struct WsLibStruct *wsptr,
+char *HeaderPtr
+)
+{
+   int  Accept,
+        ClientBits,
+        ClientNoContext,
+        ServerBits,
+        ServerBitsOffer,
+        ServerNoContext;
+   char  *cptr, *sptr, *zptr;
+   char  Param [64],
+         Value [16];
+   z_stream  *zsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   *HeaderPtr = '\0';
+
+   if (!(cptr = WsLibCgiInfo()->WebSocketExtensions))
+      return (0);
+
+   Accept = 0;
+   while (*cptr && !Accept)
+   {
+      /* comma-separated offers, each "name[; param[=value]]..." */
+      while (*cptr && (isspace(*cptr) || *cptr == ',')) cptr++;
+      if (!*cptr) break;
+
+      zptr = (sptr = Param) + sizeof(Param)-1;
+      while (*cptr && *cptr != ';' && *cptr != ',' && !isspace(*cptr) &&
+             sptr < zptr) *sptr++ = *cptr++;
+      *sptr = '\0';
+
+      Accept = !strcmp (Param, "permessage-deflate");
+      ClientBits = ClientNoContext = ServerBitsOffer = ServerNoContext = 0;
+      ServerBits = DeflateWindowBits;
+
+      for (;;)
+      {
+         while (isspace(*cptr)) cptr++;
+         if (*cptr != ';') break;
+         cptr++;
+         while (isspace(*cptr)) cptr++;
+
+         zptr = (sptr = Param) + sizeof(Param)-1;
+         while (*cptr && *cptr != '=' && *cptr != ';' && *cptr != ',' &&
+                !isspace(*cptr) && sptr < zptr) *sptr++ = *cptr++;
+         *sptr = '\0';
+
+         while (isspace(*cptr)) cptr++;
+         Value[0] = '\0';
+         if (*cptr == '=')
+         {
+            cptr++;
+            while (isspace(*cptr)) cptr++;
+            if (*cptr == '\"') cptr++;
+            zptr = (sptr = Value) + sizeof(Value)-1;
+            while (*cptr && *cptr != '\"' && *cptr != ';' && *cptr != ',' &&
+                   !isspace(*cptr) && sptr < zptr) *sptr++ = *cptr++;
+            *sptr = '\0';
+            if (*cptr == '\"') cptr++;
+         }
+
+         if (!strcmp (Param, "server_no_context_takeover"))
+            ServerNoContext = 1;
+         else
+         if (!strcmp (Param, "client_no_context_takeover"))
+            ClientNoContext = 1;
+         else
+         if (!strcmp (Param, "server_max_window_bits"))
+         {
+            /* zlib cannot generate a raw deflate with an 8 bit window */
+            ServerBitsOffer = 1;
+            if (atoi(Value) < 9 || atoi(Value) > 15)
+               Accept = 0;
+            else
+            if (atoi(Value) < ServerBits)
+               ServerBits = atoi(Value);
+         }
+         else
+         if (!strcmp (Param, "client_max_window_bits"))
+         {
+            /* the client supports it, but the value is optional */
+            if (!Value[0])
+               ClientBits = 15;
+            else
+            if (atoi(Value) < 8 || atoi(Value) > 15)
+               Accept = 0;
+            else
+               ClientBits = atoi(Value);
+            if (ClientBits > DeflateWindowBits)
+               ClientBits = DeflateWindowBits;
+         }
+         else
+            /* unknown parameter, decline this offer */
+            Accept = 0;
+      }
+
+      /* skip anything else in this offer */
+      while (*cptr && *cptr != ',') cptr++;
+   }
+
+   if (!Accept) return (0);
+
+   /* the inflate window is always maximum so it's any client window */
+   zsptr = calloc (1, sizeof(z_stream));
+   if (!zsptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+   if (inflateInit2 (zsptr, -15) != Z_OK)
+   {
+      free (zsptr);
+      return (0);
+   }
+   wsptr->InflateStreamPtr = zsptr;
+
+   zsptr = calloc (1, sizeof(z_stream));
+   if (!zsptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+   if (deflateInit2 (zsptr,
+                     DeflateLevel ? DeflateLevel : WSLIB_DEFLATE_LEVEL,
+                     Z_DEFLATED, -ServerBits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+   {
+      free (zsptr);
+      WsLib__DeflateEnd (wsptr);
+      return (0);
+   }
+   wsptr->DeflateStreamPtr = zsptr;
+
+   wsptr->DeflateLevel = DeflateLevel;
+   wsptr->DeflateWindowBits = ServerBits;
+   wsptr->DeflateNoContext = ServerNoContext || DeflateNoContext;
+   wsptr->InflateNoContext = ClientNoContext;
+
+   sptr = HeaderPtr;
+   sptr += sprintf (sptr, "Sec-WebSocket-Extensions: permessage-deflate");
+   if (wsptr->DeflateNoContext)
+      sptr += sprintf (sptr, "; server_no_context_takeover");
+   if (ClientNoContext)
+      sptr += sprintf (sptr, "; client_no_context_takeover");
+   if (ServerBitsOffer || ServerBits < 15)
+      sptr += sprintf (sptr, "; server_max_window_bits=%d", ServerBits);
+   if (ClientBits)
+      sptr += sprintf (sptr, "; client_max_window_bits=%d", ClientBits);
+   sprintf (sptr, "\r\n");
+
+   return (1);
+}
+
+/*****************************************************************************/
+/*
+Release the WebSocket's zlib streams.
+*/
+
+static void WsLib__DeflateEnd (struct WsLibStruct *wsptr)
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (wsptr->DeflateStreamPtr)
+   {
+      deflateEnd ((z_stream*)wsptr->DeflateStreamPtr);
+      free (wsptr->DeflateStreamPtr);
+      wsptr->DeflateStreamPtr = NULL;
+   }
+   if (wsptr->InflateStreamPtr)
+   {
+      inflateEnd ((z_stream*)wsptr->InflateStreamPtr);
+      free (wsptr->InflateStreamPtr);
+      wsptr->InflateStreamPtr = NULL;
+   }
+}
+
+/*****************************************************************************/
+/*
+Compress the message data (already UTF-8 if text) into a pooled buffer with
+headroom for the frame header (see WsLib__WriteAst()).  The data is flushed to
+a byte boundary and the resulting (always present) 0x00 0x00 0xff 0xff empty
+stored block removed (RFC 7692 7.2.1).  Unless no context takeover was
+negotiated the compression history carries over to the next message.  If it
+fails for some reason the message just remains uncompressed.
+*/
+
+static void WsLib__Deflate (struct WsLibMsgStruct *msgptr)
+
+{
+   int  cnt, zstatus,
+        DataSize;
+   z_stream  *zsptr;
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr = msgptr->WsLibPtr;
+   zsptr = (z_stream*)wsptr->DeflateStreamPtr;
+
+   /* worst case (incompressible) plus the flush empty stored block */
+   DataSize = deflateBound (zsptr, msgptr->DataCount) + 16;
+   msgptr->DeflatePtr = WsLib__PoolGet (wsptr, WSLIB_HEADROOM + DataSize);
+
+   zsptr->next_in = (unsigned char*)msgptr->DataPtr;
+   zsptr->avail_in = msgptr->DataCount;
+   zsptr->next_out = (unsigned char*)msgptr->DeflatePtr + WSLIB_HEADROOM;
+   zsptr->avail_out = DataSize;
+
+   zstatus = deflate (zsptr, Z_SYNC_FLUSH);
+
+   cnt = DataSize - zsptr->avail_out;
+
+   if (zstatus != Z_OK || zsptr->avail_in || !zsptr->avail_out || cnt < 4)
+   {
+      /* (restarting the history is always decompressable) */
+      WsLib__MsgCallback (wsptr, __LINE__, SS$_BUGCHECK,
+                          "deflate !SL", zstatus);
+      deflateReset (zsptr);
+      WsLib__PoolPut (wsptr, msgptr->DeflatePtr);
+      msgptr->DeflatePtr = NULL;
+      return;
+   }
+
+   /* remove the empty stored block */
+   cnt -= 4;
+
+   WATCH_WSLIB (wsptr, FI_LI, "DEFLATE !UL->!UL", msgptr->DataCount, cnt);
+
+   if (wsptr->DeflateNoContext) deflateReset (zsptr);
+
+   /* any UTF-8 encoded data is no longer required */
+   if (msgptr->Utf8Ptr)
+   {
+      WsLib__PoolPut (wsptr, msgptr->Utf8Ptr);
+      msgptr->Utf8Ptr = NULL;
+   }
+
+   msgptr->DataPtr = msgptr->DeflatePtr + WSLIB_HEADROOM;
+   msgptr->DataCount = cnt;
+   msgptr->MsgDeflate = 1;
+}
+
+/*****************************************************************************/
+/*
+Inflate the (unmasked) compressed frame data.  On the final frame of the
+message the empty stored block removed by the sender is appended (RFC 7692
+7.2.2).  Text is then validated and (if required) decoded.  When streaming,
+inflated data is delivered to the sink function in pool buffer sized pieces.
+Otherwise the inflated data (limited by the message buffer) replaces the frame
+data.  Return the number of bytes inflated (decoded if text), or -1 with the
+frame status set on error.
+*/
+
+static int WsLib__Inflate (struct WsLibFrmStruct *frmptr)
+
+{
+   static unsigned char  EmptyBlock [4] = { 0x00, 0x00, 0xff, 0xff };
+
+   int  cnt, len, zstatus,
+        Final,
+        Total,
+        Trailer;
+   unsigned long  DataLimit,
+                  DataSize;
+   char  *cptr,
+         *DataPtr;
+   z_stream  *zsptr;
+   struct WsLibStruct  *wsptr;
+   struct WsLibMsgStruct  *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   msgptr = frmptr->WsLibMsgPtr;
+   wsptr = msgptr->WsLibPtr;
+   zsptr = (z_stream*)wsptr->InflateStreamPtr;
+
+   if (msgptr->StreamFunction)
+   {
+      /* final chunk of the final frame */
+      Final = frmptr->FrameFinBit && !WsLib__ReadStreamRemain (frmptr);
+      DataSize = DataLimit = 65535;
+   }
+   else
+   {
+      Final = frmptr->FrameFinBit;
+      /* the message buffer limits how much can be inflated */
+      if (!(DataLimit = (unsigned)msgptr->DataMax))
+         DataLimit = msgptr->DataSize;
+      if (DataLimit > msgptr->DataCount)
+         DataLimit -= msgptr->DataCount;
+      else
+         DataLimit = 0;
+      if (DataLimit > 0x7fff0000) DataLimit = 0x7fff0000;
+      DataSize = frmptr->DataCount * 4 + WSLIB_POOL_MIN_SIZE;
+      if (DataSize > DataLimit) DataSize = DataLimit;
+   }
+
+   /* ensure that even for zero data some memory is allocated */
+   DataPtr = WsLib__PoolGet (wsptr, DataSize+16);
+
+   cnt = Total = Trailer = 0;
+   zsptr->next_in = (unsigned char*)frmptr->DataPtr;
+   zsptr->avail_in = frmptr->DataCount;
+
+   for (;;)
+   {
+      zsptr->next_out = (unsigned char*)DataPtr + cnt;
+      zsptr->avail_out = DataSize - cnt;
+
+      zstatus = inflate (zsptr, Z_SYNC_FLUSH);
+
+      cnt = (char*)zsptr->next_out - DataPtr;
+
+      if (zstatus == Z_STREAM_END)
+      {
+         /* sender set BFINAL, the next message begins a new stream */
+         inflateReset (zsptr);
+         break;
+      }
+
+      if (zstatus != Z_OK && zstatus != Z_BUF_ERROR)
+      {
+         WATCH_WSLIB (wsptr, FI_LI, "INFLATE !SL !AZ", zstatus,
+                      zsptr->msg ? zsptr->msg : "");
+         WsLib__MsgCallback (wsptr, __LINE__, SS$_PROTOCOL,
+                             "inflate !SL", zstatus);
+         frmptr->IOsb.iosb$w_status = SS$_PROTOCOL;
+         strcpy (msgptr->CloseMsg, "inflate failed");
+         inflateReset (zsptr);
+         WsLib__PoolPut (wsptr, DataPtr);
+         return (-1);
+      }
+
+      if (zsptr->avail_out)
+      {
+         /* all input has been inflated */
+         if (!Final || Trailer) break;
+         zsptr->next_in = EmptyBlock;
+         zsptr->avail_in = sizeof(EmptyBlock);
+         Trailer = 1;
+         continue;
+      }
+
+      /* output buffer is full */
+      if (msgptr->StreamFunction)
+      {
+         if ((len = WsLib__InflateText (frmptr, DataPtr, cnt)) < 0)
+         {
+            WsLib__PoolPut (wsptr, DataPtr);
+            return (-1);
+         }
+         if (len) (*msgptr->StreamFunction)(wsptr, DataPtr, len);
+         Total += len;
+         cnt = 0;
+         continue;
+      }
+
+      if (DataSize >= DataLimit)
+      {
+         WsLib__MsgCallback (wsptr, __LINE__, SS$_RESULTOVF,
+                             "inflated message > buffer !UL bytes",
+                             DataLimit + msgptr->DataCount);
+         frmptr->IOsb.iosb$w_status = SS$_RESULTOVF;
+         strcpy (msgptr->CloseMsg, "message too big");
+         inflateReset (zsptr);
+         WsLib__PoolPut (wsptr, DataPtr);
+         return (-1);
+      }
+
+      /* double the buffer (up to the limit) */
+      if (DataSize > DataLimit / 2)
+         DataSize = DataLimit;
+      else
+         DataSize *= 2;
+      cptr = WsLib__PoolGet (wsptr, DataSize+16);
+      memcpy (cptr, DataPtr, cnt);
+      WsLib__PoolPut (wsptr, DataPtr);
+      DataPtr = cptr;
+   }
+
+   if (Final && wsptr->InflateNoContext) inflateReset (zsptr);
+
+   if ((len = WsLib__InflateText (frmptr, DataPtr, cnt)) < 0)
+   {
+      WsLib__PoolPut (wsptr, DataPtr);
+      return (-1);
+   }
+
+   if (msgptr->StreamFunction)
+   {
+      if (len) (*msgptr->StreamFunction)(wsptr, DataPtr, len);
+      WsLib__PoolPut (wsptr, DataPtr);
+      Total += len;
+      WATCH_WSLIB (wsptr, FI_LI, "INFLATE !UL->!UL",
+                   frmptr->DataCount, Total);
+      return (Total);
+   }
+
+   WATCH_WSLIB (wsptr, FI_LI, "INFLATE !UL->!UL", frmptr->DataCount, cnt);
+
+   /* replace any allocated compressed data buffer */
+   if (frmptr->DataPtr != (char*)frmptr->FrameHeader + frmptr->FrameCount)
+      WsLib__PoolPut (wsptr, frmptr->DataPtr);
+   frmptr->DataPtr = DataPtr;
+   frmptr->DataSize = DataSize;
+   frmptr->DataCount = cnt;
+   frmptr->DecodeCount = len;
+
+   return (len);
+}
+
+/*****************************************************************************/
+/*
+Validate (and if required decode) inflated text using WsLib__Utf8Decode() and a
+frame structure describing the inflated data.  Return the resulting length, or
+-1 with the frame status set if the UTF-8 is illegal.  Binary is unchanged.
+*/
+
+static int WsLib__InflateText
+(
+struct WsLibFrmStruct *frmptr,
+char *DataPtr,
+int DataCount
+)
+{
+   int  cnt;
+   struct WsLibStruct  *wsptr;
+   struct WsLibMsgStruct  *msgptr;
+   struct WsLibFrmStruct  TextFrame;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   msgptr = frmptr->WsLibMsgPtr;
+   wsptr = msgptr->WsLibPtr;
+
+   if (msgptr->MsgOpcode != WSLIB_OPCODE_TEXT) return (DataCount);
+
+   memset (&TextFrame, 0, sizeof(TextFrame));
+   TextFrame.WsLibMsgPtr = msgptr;
+   TextFrame.DataPtr = DataPtr;
+
+   /* in chunks of (sixteen bit) I/O status block byte count */
+   while (TextFrame.DataCount < DataCount)
+   {
+      if ((cnt = DataCount - TextFrame.DataCount) > 65535) cnt = 65535;
+      TextFrame.IOsb.iosb$w_bcnt = cnt;
+      if (!WsLib__Utf8Decode (&TextFrame))
+      {
+         WATCH_WSLIB (wsptr, FI_LI, "UTF-8 illegal (fast fail)");
+         frmptr->IOsb.iosb$w_status = SS$_BADESCAPE;
+         strcpy (msgptr->CloseMsg, "UTF-8 illegal");
+         return (-1);
+      }
+      TextFrame.DataCount += cnt;
+   }
+
+   return (TextFrame.DecodeCount);
+}
+
+#endif /* WSLIB_ZLIB */
+
+/*****************************************************************************/
+/*
+Return the current wsLIB time in seconds (i.e. C-RTL, Unix time).
+*/
+
+unsigned int WsLibTime ()
+
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   return (CurrentTime);
+}
+
+/*****************************************************************************/
+/*
+Arm (or re-arm) the timer to call the function with the parameter in 'Msecs'
+milliseconds.  The caller-supplied structure must be zeroed before first use.
+*/
+
+int WsLibTimerAdd
+(
+struct WsLibTimerStruct *tmptr,
+int Msecs,
+void *AstFunction,
+void *AstParam
+)
+{
+   int  astatus;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (!WsLibEfnWait) WsLibInit ();
+
+   /* at least the next tick (see WsLib__TimerAst()) */
+   if (Msecs < 1) Msecs = 1;
+
+   astatus = sys$setast (0); 
+   tmptr->TimerFunction = AstFunction;
+   tmptr->TimerParam = AstParam;
+   WsLib__TimerSet (tmptr, WsLib__TimerMsecs() + Msecs);
+   if (astatus == SS$_WASSET) sys$setast (1);
+
+   return (SS$_NORMAL);
+}
+
+/*****************************************************************************/
+/*
+Disarm the timer.  Return true if it was armed.
+*/
+
+int WsLibTimerCancel (struct WsLibTimerStruct *tmptr)
+
+{
+   int  astatus, armed;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   astatus = sys$setast (0); 
+   armed = (tmptr->HeapIndex > 0 &&
+            tmptr->HeapIndex <= TimerHeapCount &&
+            TimerHeapPtr[tmptr->HeapIndex] == tmptr);
+   WsLib__TimerRemove (tmptr);
+   if (astatus == SS$_WASSET) sys$setast (1);
+
+   return (armed);
+}
+
+/*****************************************************************************/
+/*
+Return the current time in milliseconds (modulo 2^32, see WSLIB_MSECS_BEFORE).
+*/
+
+static unsigned int WsLib__TimerMsecs ()
 
-   utf8_nbg:
-      return (-1);
+{
+   unsigned long  BinTime [2];
+#ifdef __VAX
+   unsigned long  hi;
+   double  msecs;
+#endif
+
+   /*********/
+   /* begin */
+   /*********/
+
+   sys$gettim (&BinTime);
+
+#ifdef __VAX
+   /* no quadword arithmetic; the precision of a double is ample */
+   msecs = ((double)BinTime[1] * 4294967296.0 + (double)BinTime[0]) / 10000.0;
+   hi = (unsigned long)(msecs / 4294967296.0);
+   return ((unsigned int)(msecs - (double)hi * 4294967296.0));
+#else
+   return ((unsigned int)(*(__int64*)BinTime / 10000));
+#endif
 }
 
-/****************************************************************************/
+/*****************************************************************************/
 /*
-Given a descriptor of 8 bit ASCII convert it to UTF-8.  Can be done in-situ.
-The output descriptor must be provided even if it points to the same storage as
-the input descriptor.  Return the length of the converted string or -1 to
-indicated a conversion error.
-
+Insert (or reposition) the timer in the heap to become due at 'DueMsecs'.  If
+it becomes the earliest the $SETIMR is rescheduled.  Call with ASTs disabled
+(or at AST delivery level).
 */
 
-int WsLibToUtf8Dsc
+static void WsLib__TimerSet
 (
-struct dsc$descriptor_s *InDsc,
-struct dsc$descriptor_s *OutDsc
+struct WsLibTimerStruct *tmptr,
+unsigned int DueMsecs
 )
 {
-   int  len;
+   int  idx;
 
    /*********/
    /* begin */
    /*********/
 
-   if (InDsc->dsc$b_class != DSC$K_CLASS_S &&
-       InDsc->dsc$b_dtype != DSC$K_DTYPE_T) return (LIB$_INVSTRDES);
-
-   if (OutDsc->dsc$b_class != DSC$K_CLASS_S &&
-       OutDsc->dsc$b_dtype != DSC$K_DTYPE_T) return (LIB$_INVSTRDES);
+   WsLib__TimerRemove (tmptr);
 
-   len = WsLibToUtf8 (InDsc->dsc$a_pointer, InDsc->dsc$w_length,
-                      OutDsc->dsc$a_pointer, OutDsc->dsc$w_length);
+   if (TimerHeapCount + 1 >= TimerHeapSize)
+   {
+      TimerHeapSize = TimerHeapSize ? TimerHeapSize * 2 : 64;
+      TimerHeapPtr = realloc (TimerHeapPtr, TimerHeapSize *
+                                            sizeof(struct WsLibTimerStruct*));
+      if (!TimerHeapPtr) WsLibExit (NULL, FI_LI, vaxc$errno);
+   }
 
-   if (len == -1) return (SS$_ABORT);
+   tmptr->DueMsecs = DueMsecs;
+   idx = ++TimerHeapCount;
+   TimerHeapPtr[idx] = tmptr;
+   tmptr->HeapIndex = idx;
+   WsLib__TimerUp (idx);
 
-   return (SS$_NORMAL);
+   if (tmptr->HeapIndex == 1) WsLib__TimerSchedule ();
 }
 
-/****************************************************************************/
+/*****************************************************************************/
 /*
-Given a buffer of 8 bit ASCII text convert it to UTF-8.  This can be done
-in-situ with the worst-case the buffer space needs to be two times in size
-(i.e. every character has the hi bit set requiring a leading UTF-8 byte). 
-End-of-string is indicated by text-length not a null-character, however the
-resultant string is nulled.  Return the length of the converted string.  Return
--1 if the buffer space will be too small.
+Remove the timer from the heap (if it's there).  The heap index is checked so
+that a zeroed (or stale) structure is harmless.
 */
 
-int WsLibToUtf8
-(
-char *InPtr,
-int InLength,
-char *OutPtr,
-int SizeOfOut
-)
+static void WsLib__TimerRemove (struct WsLibTimerStruct *tmptr)
+
 {
-   int  Utf8Count = 0;
-   char  *cptr, *czptr, *sptr;
+   int  idx;
+   struct WsLibTimerStruct  *lastptr;
 
    /*********/
    /* begin */
    /*********/
 
-   if (!InPtr) return (-1);
+   idx = tmptr->HeapIndex;
+   tmptr->HeapIndex = 0;
+   if (idx <= 0 || idx > TimerHeapCount || TimerHeapPtr[idx] != tmptr) return;
 
-   if (InLength == -1) InLength = strlen(InPtr);
+   lastptr = TimerHeapPtr[TimerHeapCount--];
+   if (idx > TimerHeapCount) return;
 
-   for (czptr = (cptr = InPtr) + InLength; cptr < czptr; cptr++)
-      if (*cptr & 0x80) Utf8Count++;
+   /* move the last into the vacancy and restore the heap property */
+   TimerHeapPtr[idx] = lastptr;
+   lastptr->HeapIndex = idx;
+   WsLib__TimerUp (idx);
+   WsLib__TimerDown (lastptr->HeapIndex);
+}
 
-   if (!Utf8Count)
-   {
-      if (!OutPtr) return (InLength);
-      if (OutPtr == InPtr) return (InLength);
-      /* just copy to output buffer */
-      if (InLength >= SizeOfOut - 1) return (-1);
-      memcpy (OutPtr, InPtr, InLength);
-      OutPtr[InLength] = '\0'; 
-      return (InLength);
-   }
+/*****************************************************************************/
+/*
+Sift the heap entry towards the root while it's due before its parent.
+*/
 
-   if (InLength + Utf8Count >= SizeOfOut - 1) return (-1);
+static void WsLib__TimerUp (int idx)
 
-   cptr = (czptr = InPtr) + InLength - 1;
-   if (!(sptr = OutPtr)) sptr = InPtr;
-   sptr += InLength - 1;
-   sptr += Utf8Count + 1;
-   *sptr-- = '\0';
-   while (cptr >= czptr)
+{
+   int  pidx;
+   struct WsLibTimerStruct  *tmptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   tmptr = TimerHeapPtr[idx];
+   while (idx > 1)
    {
-      if (*cptr & 0x80)
-      {
-         *sptr-- = (*cptr & 0x3f) | 0x80;
-         *sptr-- = ((*cptr-- & 0xc0) >> 6) | 0xc0;
-      }
-      else
-         *sptr-- = *cptr--;
+      pidx = idx / 2;
+      if (!WSLIB_MSECS_BEFORE (tmptr->DueMsecs,
+                               TimerHeapPtr[pidx]->DueMsecs)) break;
+      TimerHeapPtr[idx] = TimerHeapPtr[pidx];
+      TimerHeapPtr[idx]->HeapIndex = idx;
+      idx = pidx;
    }
-
-   return (InLength + Utf8Count);
+   TimerHeapPtr[idx] = tmptr;
+   tmptr->HeapIndex = idx;
 }
 
-/****************************************************************************/
+/*****************************************************************************/
 /*
-Called with a frame pointer after reading UTF-8 data from the client.
-The data is parsed as received (i.e. not necessarily a complete message) to
-ensure the UTF-8 (received so far) appears legal.  Provides "fast fail" on
-illegal UTF-8.  Return true if legal, false if not.
+Sift the heap entry towards the leaves while a child is due before it.
+*/
 
-Algorithm and essential code ...
+static void WsLib__TimerDown (int idx)
 
-Copyright (c) 2008-2009 Bjoern Hoehrmann <bjoern@hoehrmann.de>
-See http://bjoern.hoehrmann.de/utf-8/decoder/dfa/ for details.
+{
+   int  cidx;
+   struct WsLibTimerStruct  *tmptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   tmptr = TimerHeapPtr[idx];
+   while ((cidx = idx * 2) <= TimerHeapCount)
+   {
+      if (cidx < TimerHeapCount &&
+          WSLIB_MSECS_BEFORE (TimerHeapPtr[cidx+1]->DueMsecs,
+                              TimerHeapPtr[cidx]->DueMsecs)) cidx++;
+      if (!WSLIB_MSECS_BEFORE (TimerHeapPtr[cidx]->DueMsecs,
+                               tmptr->DueMsecs)) break;
+      TimerHeapPtr[idx] = TimerHeapPtr[cidx];
+      TimerHeapPtr[idx]->HeapIndex = idx;
+      idx = cidx;
+   }
+   TimerHeapPtr[idx] = tmptr;
+   tmptr->HeapIndex = idx;
+}
+
+/*****************************************************************************/
+/*
+(Re)schedule the single $SETIMR for the earliest timer in the heap.  The
+request ID is the heap pointer's address so $CANTIM affects no other timer.
 */
 
-static int WsLib__Utf8Legal (struct WsLibFrmStruct *frmptr)
+static void WsLib__TimerSchedule ()
 
 {
-static const unsigned char  utf8d[] =
-{
-  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 00..1f
-  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 20..3f
-  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 40..5f
-  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, // 60..7f
-  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, // 80..9f
-  7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, // a0..bf
-  8,8,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, // c0..df
-  0xa,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x3,0x4,0x3,0x3, // e0..ef
-  0xb,0x6,0x6,0x6,0x5,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8,0x8, // f0..ff
-  0x0,0x1,0x2,0x3,0x5,0x8,0x7,0x1,0x1,0x1,0x4,0x6,0x1,0x1,0x1,0x1, // s0..s0
-  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,1,1,1,1,1,0,1,0,1,1,1,1,1,1, // s1..s2
-  1,2,1,1,1,1,1,2,1,2,1,1,1,1,1,1,1,1,1,1,1,1,1,2,1,1,1,1,1,1,1,1, // s3..s4
-  1,2,1,1,1,1,1,1,1,2,1,1,1,1,1,1,1,1,1,1,1,1,1,3,1,3,1,1,1,1,1,1, // s5..s6
-  1,3,1,1,1,1,1,3,1,3,1,1,1,1,1,1,1,3,1,1,1,1,1,1,1,1,1,1,1,1,1,1, // s7..s8
-};
+#ifdef __VAX
+   static unsigned long  MinusTenThousand = -10000,
+                         Zero = 0;
+#endif
 
-   int  cnt,
-        Utf8Count = 0;
-   unsigned int  byte, state, type;
-   unsigned char  *cptr, *czptr;
-   struct WsLibMsgStruct  *msgptr;
+   int  status;
+   unsigned int  Msecs, NowMsecs;
+   unsigned long  DeltaTime [2];
 
    /*********/
    /* begin */
    /*********/
 
-   msgptr = frmptr->WsLibMsgPtr;
-   state = msgptr->Utf8State;
+   /* rescheduled after all the due timers have been delivered */
+   if (TimerInAst) return;
 
-   if (!frmptr->IOsb.iosb$w_bcnt)
+   if (!TimerHeapCount)
    {
-      /* checking code-point at end of message */
-      return (state == 0);
+      if (TimerScheduled) sys$cantim (&TimerHeapPtr, 0);
+      TimerScheduled = 0;
+      return;
    }
 
-   cptr = (unsigned char*)frmptr->DataPtr + frmptr->DataCount;
-   czptr = cptr + frmptr->IOsb.iosb$w_bcnt;
-   while (cptr < czptr)
-   {
-      /* for efficiency, concurrently apply masking key */
-      if (frmptr->FrameMaskBit)
-         *cptr ^= frmptr->MaskingKey[frmptr->MaskCount++&0x3];
-      byte = *cptr++;
-      type = utf8d[byte];
-      state = utf8d[256+(state*16)+type];
-      if (!state) Utf8Count++;
-   }
-   msgptr->Utf8State = state;
-   msgptr->Utf8Count += Utf8Count;
+   if (TimerScheduled &&
+       TimerScheduledMsecs == TimerHeapPtr[1]->DueMsecs) return;
 
-   return (state != 1);
+   if (TimerScheduled) sys$cantim (&TimerHeapPtr, 0);
+
+   NowMsecs = WsLib__TimerMsecs();
+   if (WSLIB_MSECS_BEFORE (NowMsecs, TimerHeapPtr[1]->DueMsecs))
+      Msecs = TimerHeapPtr[1]->DueMsecs - NowMsecs;
+   else
+      Msecs = 1;
+
+#ifdef __VAX
+   lib$emul (&Msecs, &MinusTenThousand, &Zero, &DeltaTime);
+#else
+   *(__int64*)DeltaTime = -(__int64)Msecs * 10000;
+#endif
+
+   status = sys$setimr (0, &DeltaTime, WsLib__TimerAst, &TimerHeapPtr, 0);
+   if (VMSnok(status)) WsLibExit (NULL, FI_LI, status);
+
+   TimerScheduled = 1;
+   TimerScheduledMsecs = TimerHeapPtr[1]->DueMsecs;
 }
 
 /*****************************************************************************/
 /*
-Return the current wsLIB time in seconds (i.e. C-RTL, Unix time).
+The $SETIMR has expired.  Deliver each timer now due (removing it from the
+heap first so that it may re-add itself) then schedule for the next earliest.
 */
 
-unsigned int WsLibTime ()
+static void WsLib__TimerAst ()
 
 {
+   unsigned int  NowMsecs;
+   struct WsLibTimerStruct  *tmptr;
+
    /*********/
    /* begin */
    /*********/
 
-   return (CurrentTime);
+   TimerScheduled = 0;
+
+   sys$gettim (&CurrentBinTime);
+   CurrentTime = decc$fix_time (&CurrentBinTime);
+
+   TimerInAst = 1;
+   NowMsecs = WsLib__TimerMsecs();
+   while (TimerHeapCount &&
+          !WSLIB_MSECS_BEFORE (NowMsecs, TimerHeapPtr[1]->DueMsecs))
+   {
+      tmptr = TimerHeapPtr[1];
+      WsLib__TimerRemove (tmptr);
+      (*tmptr->TimerFunction)(tmptr->TimerParam);
+   }
+   TimerInAst = 0;
+
+   WsLib__TimerSchedule ();
 }
 
 /*****************************************************************************/
 /*
-Called every second to maintain various events in the WebSocket and application
-life-cycle.
+Called every second (via the timer heap) to maintain the wsLIB time and the
+application life-cycle.  Per-websocket deadlines are not polled here, each
+websocket has its own heap entry (see WsLib__WatchDogArm()).
 */
 
 static void WsLib__WatchDog ()
 
 {
-   static unsigned long  OneSecondDelta [2] = { -10000000, -1 };
    static unsigned long  ExitTime;
 
-   int  status,
-        StringLength;
-   char  StringBuffer [256];
    struct WsLibStruct  *wsptr;
 
    /*********/
@@ -4125,66 +6799,138 @@ static void WsLib__WatchDog ()
       if (WakeCallbackFunction) sys$dclast (WakeCallbackFunction, 0, 0, 0);
    }
 
-   for (wsptr = WsLibListHead; wsptr; wsptr = wsptr->NextPtr)
-   {
-      /* flush any watch log to disk every second */
-      if (wsptr->WatchLog) fsync (fileno(wsptr->WatchLog));
+   /* write buffered watch log records to disk every second */
+   if (WatchRingIn != WatchRingOut) WsLib__WatchDrain ();
 
-      if (wsptr->WebSocketClosed)
-      {
-         /* if not yet shut then do so after a little patience */
-         if (!wsptr->WatchDogCloseTime)
-            if (wsptr->WatchDogCloseSecs)
-               wsptr->WatchDogCloseTime = CurrentTime +
-                                          wsptr->WatchDogCloseSecs;
-            else
-               wsptr->WatchDogCloseTime = CurrentTime + WatchDogCloseSecs;
+   ClockTimer.TimerFunction = WsLib__WatchDog;
+   WsLib__TimerSet (&ClockTimer, WsLib__TimerMsecs() + 1000);
+}                            
+
+/*****************************************************************************/
+/*
+Ensure the websocket's heap entry is due no later than its earliest deadline.
+Deadlines are mostly pushed later by I/O activity and that costs nothing here;
+the entry fires at the earlier time, finds nothing due and re-arms itself for
+the now-current deadline.  Only a deadline earlier than that armed (read wait,
+close, settings changes) repositions it in the heap.
+*/
+
+static void WsLib__WatchDogArm (struct WsLibStruct *wsptr)
+
+{
+   int  astatus;
+   unsigned long  DueTime, Secs;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (wsptr->WebSocketClosed)
+   {
+      /* if not yet shut then do so after a little patience */
+      if (!wsptr->WatchDogCloseTime)
+         if (wsptr->WatchDogCloseSecs)
+            wsptr->WatchDogCloseTime = CurrentTime + wsptr->WatchDogCloseSecs;
          else
-         if (wsptr->WatchDogCloseTime < CurrentTime)
-            sys$dclast (WsLib__Shut, wsptr, 0, 0);
-      }
-      else
-      if (wsptr->WatchDogReadTime &&
-          wsptr->WatchDogReadTime < CurrentTime)
-      {
-         /* advise client to close WebSocket */
-         WsLibClose (wsptr, WSLIB_CLOSE_POLICY, "read wait exceeded");
-      }
-      else
+            wsptr->WatchDogCloseTime = CurrentTime + WatchDogCloseSecs;
+      DueTime = wsptr->WatchDogCloseTime;
+   }
+   else
+   {
+      DueTime = wsptr->WatchDogReadTime;
       if (wsptr->WatchDogIdleTime &&
-          wsptr->WatchDogIdleTime < CurrentTime)
-      {
-         /* advise client to close WebSocket */
-         WsLibClose (wsptr, WSLIB_CLOSE_POLICY, "idle connection");
-      }
-      else
+          (!DueTime || wsptr->WatchDogIdleTime < DueTime))
+         DueTime = wsptr->WatchDogIdleTime;
       if (wsptr->WatchDogPingTime &&
-          wsptr->WatchDogPingTime < CurrentTime)
-      {
-         /* periodic ping (heartbeat) to remote end */
-         StringLength = sprintf (StringBuffer, "%u %u",
-                                 ++wsptr->WatchDogPingCount, CurrentTime);
-         WsLibPing (wsptr, StringBuffer, StringLength);
-         if (wsptr->WatchDogPingSecs)
-            wsptr->WatchDogPingTime = CurrentTime +
-                                      wsptr->WatchDogPingSecs - 1;
-         else
-            wsptr->WatchDogPingCount = 0;
-      }
-      else
+          (!DueTime || wsptr->WatchDogPingTime < DueTime))
+         DueTime = wsptr->WatchDogPingTime;
       if (wsptr->WatchDogWakeTime &&
-          wsptr->WatchDogWakeTime < CurrentTime)
-      {
-         /* wake if requested */
-         wsptr->WatchDogWakeTime = CurrentTime + wsptr->WatchDogWakeSecs - 1;
-         if (wsptr->WakeCallbackFunction)
-            sys$dclast (wsptr->WakeCallbackFunction, wsptr, 0, 0);
-      }
+          (!DueTime || wsptr->WatchDogWakeTime < DueTime))
+         DueTime = wsptr->WatchDogWakeTime;
    }
 
-   status = sys$setimr (0, &OneSecondDelta, WsLib__WatchDog, 0, 0);
-   if (VMSnok(status)) WsLibExit (NULL, FI_LI, status);
-}                            
+   if (!DueTime) return;
+
+   /* already armed for the same or an earlier time */
+   if (wsptr->WatchDogTimer.HeapIndex &&
+       wsptr->WatchDogArmTime <= DueTime) return;
+
+   /* a deadline has expired when less than the current time (seconds) */
+   if (DueTime >= CurrentTime)
+      Secs = DueTime - CurrentTime + 1;
+   else
+      Secs = 1;
+   if (Secs > WSLIB_WATCHDOG_MAX_SECS) Secs = WSLIB_WATCHDOG_MAX_SECS;
+
+   astatus = sys$setast (0); 
+   wsptr->WatchDogArmTime = DueTime;
+   wsptr->WatchDogTimer.TimerFunction = WsLib__WatchDogAst;
+   wsptr->WatchDogTimer.TimerParam = wsptr;
+   WsLib__TimerSet (&wsptr->WatchDogTimer, WsLib__TimerMsecs() + Secs * 1000);
+   if (astatus == SS$_WASSET) sys$setast (1);
+}
+
+/*****************************************************************************/
+/*
+The websocket's earliest deadline (as armed) has been reached.  Action any
+actually expired and re-arm for the next.
+*/
+
+static void WsLib__WatchDogAst (struct WsLibStruct *wsptr)
+
+{
+   int  StringLength;
+   char  StringBuffer [256];
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (wsptr->WebSocketClosed)
+   {
+      if (wsptr->WatchDogCloseTime < CurrentTime)
+         sys$dclast (WsLib__Shut, wsptr, 0, 0);
+   }
+   else
+   if (wsptr->WatchDogReadTime &&
+       wsptr->WatchDogReadTime < CurrentTime)
+   {
+      /* advise client to close WebSocket */
+      WsLibClose (wsptr, WSLIB_CLOSE_POLICY, "read wait exceeded");
+   }
+   else
+   if (wsptr->WatchDogIdleTime &&
+       wsptr->WatchDogIdleTime < CurrentTime)
+   {
+      /* advise client to close WebSocket */
+      WsLibClose (wsptr, WSLIB_CLOSE_POLICY, "idle connection");
+   }
+   else
+   if (wsptr->WatchDogPingTime &&
+       wsptr->WatchDogPingTime < CurrentTime)
+   {
+      /* periodic ping (heartbeat) to remote end */
+      StringLength = sprintf (StringBuffer, "%u %u",
+                              ++wsptr->WatchDogPingCount, CurrentTime);
+      WsLibPing (wsptr, StringBuffer, StringLength);
+      if (wsptr->WatchDogPingSecs)
+         wsptr->WatchDogPingTime = CurrentTime +
+                                   wsptr->WatchDogPingSecs - 1;
+      else
+         wsptr->WatchDogPingCount = 0;
+   }
+   else
+   if (wsptr->WatchDogWakeTime &&
+       wsptr->WatchDogWakeTime < CurrentTime)
+   {
+      /* wake if requested */
+      wsptr->WatchDogWakeTime = CurrentTime + wsptr->WatchDogWakeSecs - 1;
+      if (wsptr->WakeCallbackFunction)
+         sys$dclast (wsptr->WakeCallbackFunction, wsptr, 0, 0);
+   }
+
+   WsLib__WatchDogArm (wsptr);
+}
 
 /*****************************************************************************/
 /*
@@ -4350,21 +7096,19 @@ char *FormatString,
 )
 {
    static $DESCRIPTOR (ErrorFaoDsc, "!!WATCH: $FAO %X!8XL");
-   static $DESCRIPTOR (TimeFaoDsc, "!%T\0");
    static $DESCRIPTOR (Watch1FaoDsc, "!!!!WATCH: [!AZ:!4ZL] !AZ");
    static $DESCRIPTOR (Watch2FaoDsc, "!!!!WATCH: !AZ");
 
-   int  argcnt, cnt, status;
+   int  argcnt, astatus, cnt, pos, skip, status;
    unsigned short  slen = 0;
    unsigned long  *vecptr;
    unsigned long  FaoVector [32];
    char  *aptr, *cptr;
-   char  TimeBuffer [32],
-         WatchBuffer [1024],
+   char  WatchBuffer [1024],
          WatchFao [256];
    va_list  argptr;
+   struct WsLibWatchRec  *wrptr;
    $DESCRIPTOR (FaoDsc, WatchFao);
-   $DESCRIPTOR (TimeBufferDsc, TimeBuffer);
    $DESCRIPTOR (WatchBufferDsc, WatchBuffer);
 
    /*********/
@@ -4412,13 +7156,6 @@ char *FormatString,
    if (!(status & 1))
       status = sys$fao (&ErrorFaoDsc, &slen, &WatchBufferDsc, status);
 
-   /* allocate a pointer plus a buffer (freed by WsLib__OutputFreeAst()) */ 
-   aptr = calloc (1, sizeof(struct WsLibStruct*) + slen);
-   if (!aptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
-   *(struct WsLibStruct**)aptr = wsptr;
-   cptr = aptr + sizeof(struct WsLibStruct*);
-   memcpy (cptr, WatchBuffer, slen);
-
    if (!CgiPlusEscLength && !CgiPlusEotLength)
    {
       fprintf (stdout, "%*.*s\n", slen, slen, WatchBuffer);
@@ -4427,12 +7164,56 @@ char *FormatString,
 
    if (wsptr->WatchLog)
    {
-      sys$fao (&TimeFaoDsc, 0, &TimeBufferDsc, 0);
-      fprintf (wsptr->WatchLog, "%s %*.*s\n",
-               TimeBuffer, slen-8, slen-8, WatchBuffer+8);
+      /* buffer the record (less the "!!WATCH: ") for WsLib__WatchDrain() */
+      if (!WatchRingPtr)
+         if (!(WatchRingPtr = calloc (1, WSLIB_WATCH_RING_SIZE)))
+            WsLibExit (wsptr, FI_LI, vaxc$errno);
+      cnt = WSLIB_WATCH_ALIGN (sizeof(struct WsLibWatchRec) + slen-8);
+
+      astatus = sys$setast (0);
+      pos = WatchRingIn & (WSLIB_WATCH_RING_SIZE-1);
+      /* a record never wraps, the remainder of the ring is skipped */
+      if (WSLIB_WATCH_RING_SIZE - pos < cnt)
+         skip = WSLIB_WATCH_RING_SIZE - pos;
+      else
+         skip = 0;
+      if (WatchRingIn - WatchRingOut + skip + cnt > WSLIB_WATCH_RING_SIZE)
+         /* full; drop rather than wait */
+         WatchDropCount++;
+      else
+      {
+         if (skip)
+         {
+            if (skip >= sizeof(struct WsLibWatchRec))
+               ((struct WsLibWatchRec*)(WatchRingPtr+pos))->Length = -1;
+            WatchRingIn += skip;
+            pos = 0;
+         }
+         wrptr = (struct WsLibWatchRec*)(WatchRingPtr+pos);
+         wrptr->WsLibPtr = wsptr;
+         sys$gettim (&wrptr->BinTime);
+         wrptr->Length = slen-8;
+         memcpy ((char*)(wrptr+1), WatchBuffer+8, slen-8);
+         WatchRingIn += cnt;
+      }
+      /* write now (at AST delivery) rather than waiting for the second */
+      if (!WatchDrainQueued &&
+          WatchRingIn - WatchRingOut > WSLIB_WATCH_RING_SIZE / 2)
+      {
+         WatchDrainQueued = 1;
+         sys$dclast (WsLib__WatchDrain, 0, 0, 0);
+      }
+      if (astatus == SS$_WASSET) sys$setast (1);
    }
    else
    {
+      /* allocate a pointer plus a buffer (freed by WsLib__OutputFreeAst()) */ 
+      aptr = calloc (1, sizeof(struct WsLibStruct*) + slen);
+      if (!aptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+      *(struct WsLibStruct**)aptr = wsptr;
+      cptr = aptr + sizeof(struct WsLibStruct*);
+      memcpy (cptr, WatchBuffer, slen);
+
       status = sys$qio (WsLibEfnNoWait, wsptr->OutputChannel,
                         IO$_WRITELBLK | IO$M_READERCHECK,
                         0, WsLib__OutputAst, wsptr,
@@ -4457,6 +7238,78 @@ char *FormatString,
    }
 }
 
+/*****************************************************************************/
+/*
+Write the WATCH log records buffered by WsLibWatchScript().  Called each second
+by WsLib__WatchDog(), by AST when the buffer is half full, and before a log is
+closed.  The timestamp is formatted here rather than when the record is made.
+Each log written to is then fsync()ed the once, idle logs not at all.  Any
+records dropped because the buffer was full are reported in each log written.
+*/
+
+static void WsLib__WatchDrain ()
+
+{
+   static $DESCRIPTOR (DropFaoDsc, "!%T WATCH: !UL record(s) dropped\0");
+   static $DESCRIPTOR (TimeFaoDsc, "!%T\0");
+
+   int  pos, remain;
+   unsigned long  DropCount;
+   char  TimeBuffer [64];
+   struct WsLibStruct  *wsptr;
+   struct WsLibWatchRec  *wrptr;
+   $DESCRIPTOR (TimeBufferDsc, TimeBuffer);
+
+   /*********/
+   /* begin */
+   /*********/
+
+   WatchDrainQueued = 0;
+   if (WatchDraining) return;
+   WatchDraining = 1;
+
+   while (WatchRingOut != WatchRingIn)
+   {
+      pos = WatchRingOut & (WSLIB_WATCH_RING_SIZE-1);
+      remain = WSLIB_WATCH_RING_SIZE - pos;
+      wrptr = (struct WsLibWatchRec*)(WatchRingPtr+pos);
+      if (remain < sizeof(struct WsLibWatchRec) || wrptr->Length < 0)
+      {
+         /* records never wrap, the remainder was skipped */
+         WatchRingOut += remain;
+         continue;
+      }
+      wsptr = wrptr->WsLibPtr;
+      if (wsptr->WatchLog)
+      {
+         sys$fao (&TimeFaoDsc, 0, &TimeBufferDsc, &wrptr->BinTime);
+         fprintf (wsptr->WatchLog, "%s %*.*s\n", TimeBuffer,
+                  wrptr->Length, wrptr->Length, (char*)(wrptr+1));
+         wsptr->WatchLogDirty = 1;
+      }
+      WatchRingOut += WSLIB_WATCH_ALIGN (sizeof(struct WsLibWatchRec) +
+                                         wrptr->Length);
+   }
+
+   DropCount = WatchDropCount;
+   WatchDropCount = 0;
+
+   /* group flush of (only) those written to */
+   for (wsptr = WsLibListHead; wsptr; wsptr = wsptr->NextPtr)
+   {
+      if (!wsptr->WatchLogDirty) continue;
+      wsptr->WatchLogDirty = 0;
+      if (DropCount)
+      {
+         sys$fao (&DropFaoDsc, 0, &TimeBufferDsc, 0, DropCount);
+         fprintf (wsptr->WatchLog, "%s\n", TimeBuffer);
+      }
+      fsync (fileno(wsptr->WatchLog));
+   }
+
+   WatchDraining = 0;
+}
+
 /*****************************************************************************/
 /*
 Just decrement the queued output counter.
@@ -4496,6 +7349,230 @@ void WsLib__OutputFreeAst (char *aptr)
    if (wsptr->WebSocketShut) WsLib__Shut (wsptr);
 }
 
+/*****************************************************************************/
+/*
+Return a zeroed message (and embedded frame) structure from the connection's
+free list, or if empty allocate one.  Steady-state traffic (reads, writes and
+control frames) then recycles a handful of structures rather than calling the
+C-RTL allocator with every message.
+*/
+
+static struct WsLibMsgStruct* WsLib__MsgGet (struct WsLibStruct *wsptr)
+
+{
+   struct WsLibMsgStruct  *msgptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (msgptr = wsptr->MsgFreePtr)
+   {
+      wsptr->MsgFreePtr = msgptr->NextPtr;
+      wsptr->MsgFreeCount--;
+      wsptr->PoolReuseCount++;
+      memset (msgptr, 0, sizeof(struct WsLibMsgStruct));
+   }
+   else
+   {
+      msgptr = calloc (1, sizeof(struct WsLibMsgStruct));
+      if (!msgptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+      wsptr->PoolAllocCount++;
+   }
+   msgptr->WsLibPtr = wsptr;
+   msgptr->FrameData.WsLibMsgPtr = msgptr;
+
+   return (msgptr);
+}
+
+/*****************************************************************************/
+/*
+Return the message structure to the connection's free list (or if that's
+already holding sufficient just free it).
+*/
+
+static void WsLib__MsgPut (struct WsLibMsgStruct *msgptr)
+
+{
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr = msgptr->WsLibPtr;
+
+   if (wsptr->MsgFreeCount >= WSLIB_POOL_MSG_MAX)
+      free (msgptr);
+   else
+   {
+      msgptr->NextPtr = wsptr->MsgFreePtr;
+      wsptr->MsgFreePtr = msgptr;
+      wsptr->MsgFreeCount++;
+   }
+}
+
+/*****************************************************************************/
+/*
+AST delivered after a control frame (close, ping, pong) has been written.
+Release the (pooled) message structure, decrement the queued output counter.
+*/
+
+static void WsLib__MsgFreeAst (struct WsLibFrmStruct *frmptr)
+
+{
+   struct WsLibStruct  *wsptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   wsptr = frmptr->WsLibMsgPtr->WsLibPtr;
+   WsLib__MsgPut (frmptr->WsLibMsgPtr);
+   if (wsptr->QueuedOutput) wsptr->QueuedOutput--;
+   if (wsptr->WebSocketShut) WsLib__Shut (wsptr);
+}
+
+/*****************************************************************************/
+/*
+Return a (non-zeroed) buffer of at least 'DataSize' bytes.  Buffers are sized
+in power-of-two classes from 256 bytes to 64kB, with each class having a small
+per-connection free list.  Larger requests are just allocated.  A preceding
+header records the class so that WsLib__PoolPut() needs only the pointer.
+*/
+
+static char* WsLib__PoolGet
+(
+struct WsLibStruct *wsptr,
+int DataSize
+)
+{
+   int  PoolClass,
+        PoolSize;
+   struct WsLibPoolHdr  *phptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   PoolSize = WSLIB_POOL_MIN_SIZE;
+   for (PoolClass = 0; PoolClass < WSLIB_POOL_CLASSES; PoolClass++)
+   {
+      if (DataSize <= PoolSize) break;
+      PoolSize *= 2;
+   }
+
+   if (PoolClass < WSLIB_POOL_CLASSES && wsptr->PoolFreePtr[PoolClass])
+   {
+      phptr = wsptr->PoolFreePtr[PoolClass];
+      wsptr->PoolFreePtr[PoolClass] = phptr->NextPtr;
+      wsptr->PoolFreeCount[PoolClass]--;
+      wsptr->PoolReuseCount++;
+   }
+   else
+   {
+      if (PoolClass >= WSLIB_POOL_CLASSES)
+      {
+         /* too big to pool */
+         PoolClass = -1;
+         PoolSize = DataSize;
+      }
+      phptr = malloc (sizeof(struct WsLibPoolHdr) + PoolSize);
+      if (!phptr) WsLibExit (wsptr, FI_LI, vaxc$errno);
+      phptr->PoolClass = PoolClass;
+      wsptr->PoolAllocCount++;
+   }
+
+   return ((char*)phptr + sizeof(struct WsLibPoolHdr));
+}
+
+/*****************************************************************************/
+/*
+Return a buffer obtained using WsLib__PoolGet() to its class free list (or if
+that's already holding sufficient, or it's too big to pool, just free it).
+*/
+
+static void WsLib__PoolPut
+(
+struct WsLibStruct *wsptr,
+char *DataPtr
+)
+{
+   struct WsLibPoolHdr  *phptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   phptr = (struct WsLibPoolHdr*)(DataPtr - sizeof(struct WsLibPoolHdr));
+
+   if (phptr->PoolClass < 0 ||
+       wsptr->PoolFreeCount[phptr->PoolClass] >= WSLIB_POOL_BUFFER_MAX)
+      free (phptr);
+   else
+   {
+      phptr->NextPtr = wsptr->PoolFreePtr[phptr->PoolClass];
+      wsptr->PoolFreePtr[phptr->PoolClass] = phptr;
+      wsptr->PoolFreeCount[phptr->PoolClass]++;
+   }
+}
+
+/*****************************************************************************/
+/*
+Free all the connection's pooled message structures and buffers.
+*/
+
+static void WsLib__PoolFree (struct WsLibStruct *wsptr)
+
+{
+   int  PoolClass;
+   struct WsLibMsgStruct  *msgptr;
+   struct WsLibPoolHdr  *phptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   while (msgptr = wsptr->MsgFreePtr)
+   {
+      wsptr->MsgFreePtr = msgptr->NextPtr;
+      free (msgptr);
+   }
+   wsptr->MsgFreeCount = 0;
+
+   for (PoolClass = 0; PoolClass < WSLIB_POOL_CLASSES; PoolClass++)
+   {
+      while (phptr = wsptr->PoolFreePtr[PoolClass])
+      {
+         wsptr->PoolFreePtr[PoolClass] = phptr->NextPtr;
+         free (phptr);
+      }
+      wsptr->PoolFreeCount[PoolClass] = 0;
+   }
+}
+
+/*****************************************************************************/
+/*
+Return the number of allocations made, and the number of times a pooled
+structure or buffer was reused instead, for the connection.  With interactive
+traffic the allocation count should quickly stop increasing.
+*/
+
+void WsLibPoolStats
+(
+struct WsLibStruct *wsptr,
+unsigned long *AllocCountPtr,
+unsigned long *ReuseCountPtr
+)
+{
+   /*********/
+   /* begin */
+   /*********/
+
+   if (AllocCountPtr) *AllocCountPtr = wsptr->PoolAllocCount;
+   if (ReuseCountPtr) *ReuseCountPtr = wsptr->PoolReuseCount;
+}
+
 /*****************************************************************************/
 /*
 Just used for WATCH purposes.
@@ -4715,7 +7792,7 @@ char* WsLibCgiVarNull (char *VarName)
                 *StructBufferPtr;
    static FILE  *CgiPlusIn;
 
-   int  Length;
+   int  Length, RecOffset;
    char  WwwVarName [256];
    char  *bptr, *cptr, *sptr;
 
@@ -4734,6 +7811,7 @@ char* WsLibCgiVarNull (char *VarName)
    {
       /* initialize */
       StructLength = WwwPrefix = 0;
+      CgiIndexCount = CgiInfoValid = 0;
       NextVarNamePtr = StructBufferPtr;
       if (VarName == NULL) return (NULL);
    }
@@ -4771,6 +7849,7 @@ char* WsLibCgiVarNull (char *VarName)
 
       /* hmmm, not initialized */
       if (!StructLength) return (NULL);
+      if (!CgiIndexCount) WsLib__CgiIndex (StructBufferPtr);
 
       if (VarName[0] == '*')
       {
@@ -4786,11 +7865,10 @@ char* WsLibCgiVarNull (char *VarName)
       }
 
       /* return a pointer to this CGIplus variable's value */
-      for (bptr = StructBufferPtr;
-           Length = *(USHORTPTR)bptr;
-           bptr += Length)
+      for (Length = WsLib__CgiHash (VarName) & (CgiIndexSize-1);
+           sptr = CgiIndexPtr[Length];
+           Length = (Length + 1) & (CgiIndexSize-1))
       {
-         sptr = (bptr += SOUS);
          for (cptr = VarName; *cptr && *sptr && *sptr != '='; cptr++, sptr++)
             if (toupper(*cptr) != toupper(*sptr)) break;
          /* if found return a pointer to the value */
@@ -4859,24 +7937,42 @@ char* WsLibCgiVarNull (char *VarName)
       /*********************/
 
       /* reconstructs the original 'struct'ure from the records */
-      sptr = (bptr = StructBufferPtr) + StructBufferSize;
-      while (fgets (bptr+SOUS, sptr-(bptr+SOUS), CgiPlusIn) != NULL)
+      RecOffset = 0;
+      Length = SOUS;
+      for (;;)
       {
-         /* first empty record (line) terminates variables */
-         if (bptr[SOUS] == '\n') break;
+         if (StructBufferSize - Length < 256)
+         {
+            /* expand the buffer retaining what has been read */
+            StructBufferSize *= 2;
+            bptr = realloc (StructBufferPtr, StructBufferSize);
+            if (!bptr) WsLibExit (NULL, FI_LI, vaxc$errno);
+            NextVarNamePtr = StructBufferPtr = bptr;
+         }
+         /* each mailbox record is a variable (so one read each) */
+         bptr = StructBufferPtr + Length;
+         if (!fgets (bptr, StructBufferSize - Length, CgiPlusIn)) break;
+         if (!(cptr = strchr (bptr, '\n')))
+         {
+            /* longer than the buffer remaining, read the rest of it */
+            Length += strlen (bptr);
+            continue;
+         }
          /* note the location of the length word */
-         cptr = bptr;
-         for (bptr += SOUS; *bptr && *bptr != '\n'; bptr++);
-         if (*bptr != '\n') WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
-         *bptr++ = '\0';
-         if (bptr >= sptr) WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
+         sptr = StructBufferPtr + RecOffset;
+         /* first empty record (line) terminates variables */
+         if (cptr == sptr + SOUS) break;
+         *cptr++ = '\0';
+         if (cptr - (sptr + SOUS) > 65535)
+            WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
          /* update the length word */
-         *(USHORTPTR)cptr = bptr - (cptr + SOUS);
+         *(USHORTPTR)sptr = cptr - (sptr + SOUS);
+         RecOffset = cptr - StructBufferPtr;
+         Length = RecOffset + SOUS;
       }
-      if (bptr >= sptr) WsLibExit (NULL, FI_LI, SS$_BUGCHECK);
       /* terminate with a zero-length entry */
-      *(USHORTPTR)bptr = 0;
-      StructLength = (bptr + SOUS) - StructBufferPtr;
+      *(USHORTPTR)(StructBufferPtr + RecOffset) = 0;
+      StructLength = RecOffset + SOUS;
    }
 
    if (!CalloutDone && !CgiPlusVarRecordPtr[0])
@@ -4897,10 +7993,132 @@ char* WsLibCgiVarNull (char *VarName)
    sptr = StructBufferPtr + SOUS;
    if (*(ULONGPTR)sptr == 'WWW_') WwwPrefix = 1;
 
+   WsLib__CgiIndex (StructBufferPtr);
+
    return (NULL);
 
 #  undef SOUS
 }
 
 /*****************************************************************************/
+/*
+Index the CGIplus variable structure (length word, "NAME=value", ...
+terminated by a zero length word) so WsLibCgiVarNull() does not scan and
+compare every variable for each lookup.  The index is an open-addressed
+(linear probe) hash table of pointers to each name, sized to a power of two
+at least twice the number of variables.  Where a name is duplicated the first
+occurence is probed first, as it was found first by the original scan.
+*/
+
+static void WsLib__CgiIndex (char *StructPtr)
+
+{
+#define SOUS sizeof(unsigned short)
+
+   int  cnt, idx, size;
+   char  *bptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   cnt = 0;
+   for (bptr = StructPtr; *(USHORTPTR)bptr; bptr += SOUS + *(USHORTPTR)bptr)
+      cnt++;
+
+   for (size = 64; size < cnt * 2; size *= 2);
+   if (size > CgiIndexSize)
+   {
+      if (CgiIndexPtr) free (CgiIndexPtr);
+      CgiIndexPtr = calloc (size, sizeof(char*));
+      if (!CgiIndexPtr) WsLibExit (NULL, FI_LI, vaxc$errno);
+      CgiIndexSize = size;
+   }
+   else
+      memset (CgiIndexPtr, 0, CgiIndexSize * sizeof(char*));
+
+   for (bptr = StructPtr; *(USHORTPTR)bptr; bptr += SOUS + *(USHORTPTR)bptr)
+   {
+      for (idx = WsLib__CgiHash (bptr+SOUS) & (CgiIndexSize-1);
+           CgiIndexPtr[idx];
+           idx = (idx + 1) & (CgiIndexSize-1));
+      CgiIndexPtr[idx] = bptr + SOUS;
+   }
+
+   /* a non-zero count indicates the index is current */
+   CgiIndexCount = cnt ? cnt : 1;
+
+#  undef SOUS
+}
+
+/*****************************************************************************/
+/*
+Case-insensitive (FNV-1a) hash of the variable name, up to any '='.
+*/
+
+static unsigned long WsLib__CgiHash (char *NamePtr)
+
+{
+   unsigned long  hash;
+   char  *cptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   hash = 2166136261;
+   for (cptr = NamePtr; *cptr && *cptr != '='; cptr++)
+   {
+      hash ^= (unsigned char)toupper(*cptr);
+      hash = (hash * 16777619) & 0xffffffff;
+   }
+   return (hash);
+}
+
+/*****************************************************************************/
+/*
+Return a pointer to a structure containing the CGI variables most commonly
+required by wsLIB and its applications, those of integer value already
+converted.  Obtained (once) per request, after WsLibCgiVar("") synchronises
+it (or on first call in a standard CGI environment).  A variable that does
+not exist is a NULL pointer or zero integer.  As with WsLibCgiVar() the
+strings must not be modified.
+*/
+
+struct WsLibCgiStruct* WsLibCgiInfo ()
+
+{
+   char  *cptr;
+
+   /*********/
+   /* begin */
+   /*********/
+
+   if (CgiInfoValid) return (&CgiInfo);
+
+   memset (&CgiInfo, 0, sizeof(CgiInfo));
+
+   CgiInfo.HttpHost = WsLibCgiVarNull ("HTTP_HOST");
+   CgiInfo.RemoteAddr = WsLibCgiVarNull ("REMOTE_ADDR");
+   CgiInfo.RemoteUser = WsLibCgiVarNull ("REMOTE_USER");
+   CgiInfo.RequestScheme = WsLibCgiVarNull ("REQUEST_SCHEME");
+   CgiInfo.ServerSoftware = WsLibCgiVarNull ("SERVER_SOFTWARE");
+   CgiInfo.WebSocketExtensions =
+      WsLibCgiVarNull ("HTTP_SEC_WEBSOCKET_EXTENSIONS");
+   CgiInfo.WebSocketInput = WsLibCgiVarNull ("WEBSOCKET_INPUT");
+   CgiInfo.WebSocketOutput = WsLibCgiVarNull ("WEBSOCKET_OUTPUT");
+
+   if (cptr = WsLibCgiVarNull ("WEBSOCKET_INPUT_MRS"))
+      CgiInfo.InputMrs = atoi(cptr);
+   if (cptr = WsLibCgiVarNull ("WEBSOCKET_OUTPUT_MRS"))
+      CgiInfo.OutputMrs = atoi(cptr);
+   if (cptr = WsLibCgiVarNull ("HTTP_SEC_WEBSOCKET_VERSION"))
+      CgiInfo.WebSocketVersion = atoi(cptr);
+
+   /* CGIplus variables are not available until synchronised */
+   if (!WsLibIsCgiPlus() || CgiIndexCount) CgiInfoValid = 1;
+   return (&CgiInfo);
+}
+
+/*****************************************************************************/
 
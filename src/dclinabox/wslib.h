@@ -91,12 +91,15 @@ static struct WsLibIOsb {
 
 struct WsLibFrmStruct
 {
-   char  *DataPtr,
+   char  *BufDataPtr,
+         *DataPtr,
          *MaskedPtr,
          *MrsDataPtr;
 
-   int  DataCount,
+   int  BufDataCount,
+        DataCount,
         DataSize,
+        DecodeCount,
         FrameCount,
         FrameFinBit,
         FrameMaskBit,
@@ -110,12 +113,99 @@ struct WsLibFrmStruct
         ReadSize,
         WriteCount;
 
+   /* quadwords (see WsLibReadStream()) */
+   unsigned long  FrameLength [2],
+                  StreamCount [2];
+
    /* sufficient extra space to accomodate <=125 byte transmitted data */
    unsigned char  FrameHeader [2+4+125],
                   MaskingKey [4];
 
    struct WsLibIOsb  IOsb;
    struct WsLibMsgStruct  *WsLibMsgPtr;
+
+   void  (*BufAstFunction)();
+};
+
+/* room for the largest (masked) frame header in front of data */
+#define WSLIB_HEADROOM 16
+
+/* pooled buffers (see WsLib__PoolGet()) */
+
+#define WSLIB_POOL_CLASSES      9  /* 256 bytes to 64kB */
+#define WSLIB_POOL_MIN_SIZE   256
+#define WSLIB_POOL_BUFFER_MAX   4  /* per class per connection */
+#define WSLIB_POOL_MSG_MAX      8  /* per connection */
+
+/* permessage-deflate (see WsLibSetDeflate()) */
+
+#define WSLIB_DEFLATE_LEVEL     6  /* zlib default compression level */
+#define WSLIB_DEFLATE_MIN      64  /* smaller messages sent uncompressed */
+
+struct WsLibPoolHdr
+{
+   struct WsLibPoolHdr  *NextPtr;
+   int  PoolClass;
+   /* keep the following buffer quadword aligned */
+   int  Filler;
+};
+
+/* message fragment (frame) data (see WsLibReadIov()) */
+
+struct WsLibIovStruct
+{
+   char  *DataPtr;
+   int  DataCount;
+};
+
+/* commonly used CGI variables (see WsLibCgiInfo()) */
+
+struct WsLibCgiStruct
+{
+   int  InputMrs,
+        OutputMrs,
+        WebSocketVersion;
+   char  *HttpHost,
+         *RemoteAddr,
+         *RemoteUser,
+         *RequestScheme,
+         *ServerSoftware,
+         *WebSocketExtensions,
+         *WebSocketInput,
+         *WebSocketOutput;
+};
+
+/* buffered WATCH log record header (see WsLib__WatchDrain()) */
+
+struct WsLibWatchRec
+{
+   struct WsLibStruct  *WsLibPtr;
+   unsigned long  BinTime [2];
+   int  Length;
+};
+
+/* timer (see WsLibTimerAdd()) */
+
+struct WsLibTimerStruct
+{
+   int  HeapIndex;
+   unsigned int  DueMsecs;
+   void  (*TimerFunction)();
+   void  *TimerParam;
+};
+
+/* pre-framed, shareable message (see WsLibMsgPrepare()) */
+
+struct WsLibPrepStruct
+{
+   char  *DataPtr,
+         *FramePtr;
+
+   int  DataCount,
+        FrameCount,
+        FrameLength,
+        Opcode,
+        RefCount;
 };
 
 /* message data structure */
@@ -123,25 +213,38 @@ struct WsLibFrmStruct
 struct WsLibMsgStruct
 {
    char  *DataPtr,
+         *DeflatePtr,
          *Utf8Ptr;
 
    int  DataCount,
         DataMax,
         DataSize,
+        Headroom,
+        IovCount,
+        IovMode,
+        IovSize,
+        MsgDeflate,
         MsgOpcode,
         MsgStatus,
+        QueuedCount,
         Utf8Count,
         WriteCount;
 
-   unsigned int  Utf8State;
+   unsigned int  Utf8Codep,
+                 Utf8State;
+
+   struct WsLibIovStruct  *IovPtr;
+   struct WsLibPrepStruct  *PrepPtr;
 
    /* small string describing any specifics of the close */
    char  CloseMsg [32];
 
    struct WsLibFrmStruct  FrameData;
 
-   void  (*AstFunction)();
+   void  (*AstFunction)(),
+         (*StreamFunction)();
    struct WsLibStruct  *WsLibPtr;
+   struct WsLibMsgStruct  *NextPtr;
 };
 
 /* WebSocket data structure */
@@ -155,30 +258,48 @@ struct WsLibStruct
                   ClientServerPort,
                   ClientServerSize,
                   ClientUriSize,
+                  DeflateLevel,
+                  DeflateNoContext,
+                  DeflateWindowBits,
                   FrameMaxSize,
                   InBufferCount,
                   InBufferSize,
+                  InflateNoContext,
+                  InputBufCount,
+                  InputBufSize,
                   InputDataCount,
                   InputDataMax,
                   InputDataSize,
                   InputFinBit,
+                  InputIovCount,
                   InputMrs,
                   InputOpcode,
                   InputStatus,
                   MsgLineNumber,
                   MsgStringLength,
                   MsgStringSize,
+                  MsgFreeCount,
                   Opcode,
                   OutBufferSize,
+                  OutputBlocked,
+                  OutputByteLimit,
                   OutputDataCount,
                   OutputMrs,
+                  OutputMsgLimit,
+                  OutputQueuedBytes,
+                  OutputQueuedMsgs,
                   OutputStatus,
+                  PoolAllocCount,
+                  PoolFreeCount [WSLIB_POOL_CLASSES],
+                  PoolReuseCount,
                   QueuedInput,
                   QueuedOutput,
                   SetBinary,
                   SetAscii,
                   SetUtf8,
+                  WatchLogDirty,
                   WatchScript,
+                  WatchDogArmTime,
                   WatchDogCloseTime,
                   WatchDogCloseSecs,
                   WatchDogIdleSecs,
@@ -193,10 +314,13 @@ struct WsLibStruct
                   WebSocketClosed,
                   WebSocketShut,
                   WebSocketVersion,
+                  WriteHeadroom,
                   RoleClient;
 
    unsigned long  InputCount [2],
+                  InputIoCount [2],
                   InputMsgCount [2],
+                  InputStreamCount [2],
                   MsgBinTime [2],
                   OutputCount [2],
                   OutputMsgCount [2];
@@ -214,6 +338,8 @@ struct WsLibStruct
          *ClientServerPtr,
          *ClientUriPtr,
          *InBufferPtr,
+         *InputBufCurPtr,
+         *InputBufPtr,
          *InputDataPtr,
          *InFramePtr,
          *MsgStringPtr,
@@ -232,7 +358,8 @@ struct WsLibStruct
          (*DestroyAstFunction)(),
          (*MsgCallbackFunction)(),
          (*PongCallbackFunction)(),
-         (*WakeCallbackFunction)();
+         (*WakeCallbackFunction)(),
+         (*WritableCallbackFunction)();
 
    struct dsc$descriptor_s  CalloutDataDsc,
                             MsgDsc,
@@ -243,18 +370,40 @@ struct WsLibStruct
 
    struct dsc$descriptor_s  *ReadDscPtr;
 
+   struct WsLibIovStruct  *InputIovPtr;
+
+   struct WsLibMsgStruct  *MsgFreePtr;
+   struct WsLibPrepStruct  *WritePrepPtr;
+   struct WsLibTimerStruct  WatchDogTimer;
+   struct WsLibPoolHdr  *PoolFreePtr [WSLIB_POOL_CLASSES];
+
    struct sockaddr_in  SocketName;
    int  SocketNameItem [2];
 
-   struct WsLibIOsb  InputIOsb,
+   struct WsLibIOsb  InputBufIOsb,
+                     InputIOsb,
                      OutputIOsb,
                      SocketIOsb;
 
+   /* zlib z_stream (only when compiled with WSLIB_ZLIB) */
+   void  *DeflateStreamPtr,
+         *InflateStreamPtr;
+
    void  *UserDataPtr;
 
-   struct WsLibStruct  *NextPtr;
+   /* slab slot (see WsLib__SlabGet()) */
+   unsigned long  SlabGeneration,
+                  SlabInUse,
+                  SlabIndex;
+
+   struct WsLibStruct  *NextPtr,
+                       *PrevPtr;
 };
 
+/* connection handle is slab generation (high word) and index (low word) */
+#define WSLIB_SLAB_MAX   65535
+#define WSLIB_SLAB_CHUNK    64
+
 /***********************/
 /* function prototypes */
 /***********************/
@@ -262,6 +411,8 @@ struct WsLibStruct
 struct WsLibStruct* WsLibCreate (void*, void*);
 void* WsLibDestroy (struct WsLibStruct*);
 struct WsLibStruct* WsLibNext (struct WsLibStruct**);
+unsigned long WsLibHandle (struct WsLibStruct*);
+struct WsLibStruct* WsLibFromHandle (unsigned long);
 
 void WsLibSetUserData (struct WsLibStruct*, void*);
 void* WsLibGetUserData (struct WsLibStruct*);
@@ -291,7 +442,6 @@ int WsLibPong (struct WsLibStruct*, char*, int);
 void WsLibClose (struct WsLibStruct*, int, char*);
 int WsLibIsClosed (struct WsLibStruct*);
 static void WsLib__Close (struct WsLibFrmStruct*);
-static void WsLib__CloseFreeAst (struct WsLibFrmStruct*);
 static void WsLib__Destroy (struct WsLibStruct*);
 static void WsLib__DummyClose (struct WsLibStruct*);
 static int WsLib__PingPong (struct WsLibStruct*, char*, int, int);
@@ -307,30 +457,53 @@ int WsLibReadFree (struct WsLibStruct*);
 char* WsLibReadGrab (struct WsLibStruct*);
 int WsLibReadIsBinary (struct WsLibStruct*);
 int WsLibReadIsText (struct WsLibStruct*);
+int WsLibReadIov (struct WsLibStruct*, int, void*);
+int WsLibReadIovCount (struct WsLibStruct*);
+char* WsLibReadIovData (struct WsLibStruct*, int);
+char* WsLibReadIovFlatten (struct WsLibStruct*, int*);
+void WsLibReadIovFree (struct WsLibStruct*);
+int WsLibReadIovLength (struct WsLibStruct*, int);
+int WsLibReadStream (struct WsLibStruct*, void*, void*);
+unsigned long* WsLibReadStreamTotal (struct WsLibStruct*);
 int WsLibReadStatus (struct WsLibStruct*);
 unsigned long* WsLibReadTotal (struct WsLibStruct*);
+unsigned long* WsLibReadIoTotal (struct WsLibStruct*);
 unsigned long* WsLibReadMsgTotal (struct WsLibStruct*);
 
 int WsLibWrite (struct WsLibStruct*, char*, int, void*);
 int WsLibWriteDsc (struct WsLibStruct*, struct dsc$descriptor_s*, void*);
+int WsLibWriteHeadroom (struct WsLibStruct*, char*, int, int, void*);
+struct WsLibPrepStruct* WsLibMsgAppend (struct WsLibPrepStruct*,
+                                        char*, int, int);
+struct WsLibPrepStruct* WsLibMsgPrepare (char*, int, int);
+int WsLibWritePrepared (struct WsLibStruct*, struct WsLibPrepStruct*, void*);
+void WsLibMsgRelease (struct WsLibPrepStruct*);
 void WsLibWriteClose (struct WsLibStruct*, void*);
 unsigned long* WsLibWriteTotal (struct WsLibStruct*);
 unsigned long* WsLibWriteMsgTotal (struct WsLibStruct*);
 int WsLibWriteStatus (struct WsLibStruct*);
+int WsLibIsWritable (struct WsLibStruct*);
+int WsLibOutputQueued (struct WsLibStruct*, int*);
+void WsLibSetDeflate (int, int);
+int WsLibSetDeflateLevel (struct WsLibStruct*, int);
+int WsLibIsDeflate (struct WsLibStruct*);
 
 void* WsLibSetCallout (struct WsLibStruct*, void*);
 void* WsLibSetMsgCallback (struct WsLibStruct*, void*);
 void* WsLibSetPingCallback (struct WsLibStruct*, void*);
 void* WsLibSetPongCallback (struct WsLibStruct*, void*);
 void* WsLibSetWakeCallback (struct WsLibStruct*, void*, int);
+void* WsLibSetWritableCallback (struct WsLibStruct*, void*);
 void WsLibSetCloseSecs (struct WsLibStruct*, int);
 void WsLibSetIdleSecs (struct WsLibStruct*, int);
 void WsLibSetLifeSecs (int);
 void WsLibSetPingSecs (struct WsLibStruct*, int);
 void WsLibSetReadSecs (struct WsLibStruct*, int);
+void WsLibSetOutputLimit (struct WsLibStruct*, int, int);
 
 char* WsLibCgiVar (char*);
 char* WsLibCgiVarNull (char*);
+struct WsLibCgiStruct* WsLibCgiInfo ();
 void WsLibCgiPlusEof ();
 void WsLibCgiPlusEot ();
 void WsLibCgiPlusEsc ();
@@ -341,28 +514,66 @@ char* WsLibVersion ();
 
 void WsLibInit();
 unsigned int WsLibTime();
+int WsLibTimerAdd (struct WsLibTimerStruct*, int, void*, void*);
+int WsLibTimerCancel (struct WsLibTimerStruct*);
 void WsLibExit (struct WsLibStruct*, char*, int, int);
 void WsLibFree (char*);
 struct dsc$descriptor_s* WsLibMsgDsc (struct WsLibStruct*);
 char* WsLibMsgString (struct WsLibStruct*);
 int WsLibMsgLineNumber (struct WsLibStruct*);
 void WsLibResetMsg (struct WsLibStruct *wsptr);
+void WsLibPoolStats (struct WsLibStruct*, unsigned long*, unsigned long*);
 
+static unsigned long WsLib__CgiHash (char*);
+static void WsLib__CgiIndex (char*);
+static void WsLib__Mask (unsigned char*, unsigned char*, int,
+                         unsigned char*, int*);
 static void WsLib__MaskingKey (struct WsLibFrmStruct*);
 static void WsLib__MsgCallback (struct WsLibStruct*, int, int, char*, ...);
+static void WsLib__MsgFreeAst (struct WsLibFrmStruct*);
+static struct WsLibMsgStruct* WsLib__MsgGet (struct WsLibStruct*);
+static void WsLib__MsgPut (struct WsLibMsgStruct*);
 static void WsLib__OutputAst (struct WsLibStruct*);
 static void WsLib__OutputFreeAst (char*);
+static void WsLib__PoolFree (struct WsLibStruct*);
+static char* WsLib__PoolGet (struct WsLibStruct*, int);
+static void WsLib__PoolPut (struct WsLibStruct*, char*);
 static void WsLib__Pong (struct WsLibFrmStruct*);
+static struct WsLibStruct* WsLib__SlabGet ();
+static void WsLib__SlabPut (struct WsLibStruct*);
+static void WsLib__ReadBufferAst (struct WsLibFrmStruct*);
 static void WsLib__ReadFrame (struct WsLibMsgStruct*);
 static void WsLib__ReadHeader1Ast (struct WsLibFrmStruct*);
 static void WsLib__ReadHeader2Ast (struct WsLibFrmStruct*);
 static void WsLib__ReadDataAst (struct WsLibFrmStruct*);
-static int WsLib__Utf8Legal (struct WsLibFrmStruct*);
+static int WsLib__ReadInput (struct WsLibFrmStruct*, char*, int, void*);
+static int WsLib__ReadStreamRemain (struct WsLibFrmStruct*);
+static int WsLib__ReadStreamSink (struct WsLibFrmStruct*);
+static int WsLib__Utf8Count (char*, int);
+static int WsLib__Utf8Decode (struct WsLibFrmStruct*);
+static void WsLib__Utf8Encode (unsigned char*, unsigned char*, int);
+static void WsLib__TimerAst ();
+static void WsLib__TimerDown (int);
+static unsigned int WsLib__TimerMsecs ();
+static void WsLib__TimerRemove (struct WsLibTimerStruct*);
+static void WsLib__TimerSchedule ();
+static void WsLib__TimerSet (struct WsLibTimerStruct*, unsigned int);
+static void WsLib__TimerUp (int);
 static void WsLib__WatchDog ();
+static void WsLib__WatchDogArm (struct WsLibStruct*);
+static void WsLib__WatchDogAst (struct WsLibStruct*);
+static void WsLib__WatchDrain ();
 static void WsLib__WriteAst (struct WsLibFrmStruct*);
 static void WsLib__WriteEofAst (struct WsLibStruct*);
 static void WsLib__WriteMrsAst (struct WsLibFrmStruct*);
 static char* WsLib__OpCodeName (int);
+#ifdef WSLIB_ZLIB
+static void WsLib__Deflate (struct WsLibMsgStruct*);
+static void WsLib__DeflateEnd (struct WsLibStruct*);
+static int WsLib__DeflateOffer (struct WsLibStruct*, char*);
+static int WsLib__Inflate (struct WsLibFrmStruct*);
+static int WsLib__InflateText (struct WsLibFrmStruct*, char*, int);
+#endif
 
 /* for the WSLIBCL.C module */
 int WsLibClBreakNow (struct WsLibStruct*);